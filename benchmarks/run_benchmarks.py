@@ -0,0 +1,59 @@
+"""Run the emulator benchmark kernels and write the results as JSON.
+
+    python benchmarks/run_benchmarks.py -o results.json
+    python benchmarks/run_benchmarks.py --compare results.json
+
+With --compare the run fails if a kernel got slower than the baseline by
+more than the tolerance.
+"""
+import argparse
+import json
+import sys
+
+import avr
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-k', '--kernel', help='only run this kernel')
+    parser.add_argument('-n', '--instructions', type=int, default=10000000)
+    parser.add_argument('-r', '--repeats', type=int, default=3)
+    parser.add_argument('-o', '--output', help='write the results to this file')
+    parser.add_argument('--compare', help='baseline results to check against')
+    parser.add_argument('--tolerance', type=float, default=0.10,
+                        help='allowed slowdown against the baseline (default 0.10)')
+    args = parser.parse_args()
+
+    results = avr.benchmark(args.kernel, args.instructions, args.repeats)
+    report = {'instructions': args.instructions, 'repeats': args.repeats, 'results': results}
+
+    for result in results:
+        print('{kernel:20} {class:11} {mips:10.2f} MIPS {ns_per_instruction:8.2f} ns/inst'.format(**result),
+              file=sys.stderr)
+
+    if args.output:
+        with open(args.output, 'w') as output:
+            json.dump(report, output, indent=2)
+    else:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+
+    if args.compare:
+        with open(args.compare) as baseline_file:
+            baseline = {result['kernel']: result for result in json.load(baseline_file)['results']}
+        regressions = 0
+        for result in results:
+            before = baseline.get(result['kernel'])
+            if before is None:
+                continue
+            change = result['mips'] / before['mips'] - 1
+            if change < -args.tolerance:
+                regressions += 1
+                print('regression: {} {:.2f} -> {:.2f} MIPS ({:+.1%})'.format(
+                    result['kernel'], before['mips'], result['mips'], change), file=sys.stderr)
+        return 1 if regressions else 0
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -6,7 +6,12 @@ setup(
             name="avr",  # as it would be imported
                                # may include packages/namespaces separated by `.`
 
-            sources=["src/avr/avrcmodule.c"], # all sources are compiled into a single binary file
+            sources=["src/avr/avrcmodule.c", "src/avr/avr_core.c", "src/avr/avr_uart.c",
+                     "src/avr/avr_pacing.c", "src/avr/avr_image.c", "src/avr/avr_kernels.c",
+                     "src/avr/avr_fuzz.c", "src/avr/avr_replay.c",
+                     "src/avr/avr_history.c", "src/avr/avr_fault.c",
+                     "src/avr/avr_spi.c", "src/avr/avr_system.c", "src/avr/avr_storage.c",
+                     "src/avr/avr_decode.c", "src/avr/avr_block.c", "src/avr/avr_validate.c"], # all sources are compiled into a single binary file
             include_dirs=["src/avr"], # include directories
         ),
     ]
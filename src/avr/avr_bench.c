@@ -0,0 +1,113 @@
+/* avr-bench, emulator throughput per instruction class */
+
+#include "avr_kernels.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_INSTRUCTIONS (10000000)
+#define DEFAULT_REPEATS (3)
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-n instructions] [-r repeats] [-k kernel] [-j] [-l]\n"
+            "  -n instructions  instructions per run (default %d)\n"
+            "  -r repeats       runs per kernel, the fastest counts (default %d)\n"
+            "  -k kernel        only run this kernel\n"
+            "  -j               print the results as JSON\n"
+            "  -l               list the kernels\n",
+            name, DEFAULT_INSTRUCTIONS, DEFAULT_REPEATS);
+}
+
+static void
+print_json(const avr_bench_result *result, int first)
+{
+    printf("%s\n    {\"kernel\": \"%s\", \"class\": \"%s\", \"instructions\": %llu, \"cycles\": %llu, "
+           "\"elapsed_ns\": %llu, \"mips\": %.3f, \"ns_per_instruction\": %.3f, \"cycles_per_second\": %.0f}",
+           first ? "" : ",",
+           result->kernel->name, result->kernel->instruction_class,
+           (unsigned long long)result->instructions, (unsigned long long)result->cycles,
+           (unsigned long long)result->elapsed_ns, result->mips, result->ns_per_instruction,
+           result->cycles_per_second);
+}
+
+static void
+print_text(const avr_bench_result *result)
+{
+    printf("%-20s %-11s %10.2f %8.2f %14.0f\n",
+           result->kernel->name, result->kernel->instruction_class,
+           result->mips, result->ns_per_instruction, result->cycles_per_second);
+}
+
+int
+main(int argc, char **argv)
+{
+    uint64_t instructions = DEFAULT_INSTRUCTIONS;
+    int repeats = DEFAULT_REPEATS;
+    const char *only = NULL;
+    int json = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:r:k:jlh")) != -1) {
+        switch (option) {
+        case 'n':
+            instructions = strtoull(optarg, NULL, 0);
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            break;
+        case 'k':
+            only = optarg;
+            if (avr_bench_find(only) == NULL) {
+                fprintf(stderr, "unknown kernel: %s\n", only);
+                return 2;
+            }
+            break;
+        case 'j':
+            json = 1;
+            break;
+        case 'l':
+            for (const avr_bench_kernel *kernel = avr_bench_kernels; kernel->name != NULL; kernel++)
+                printf("%-20s %s\n", kernel->name, kernel->instruction_class);
+            return 0;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0 : 2;
+        }
+    }
+    if (instructions == 0 || repeats < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (json)
+        printf("{\"instructions\": %llu, \"repeats\": %d, \"results\": [", (unsigned long long)instructions, repeats);
+    else
+        printf("%-20s %-11s %10s %8s %14s\n", "kernel", "class", "MIPS", "ns/inst", "cycles/s");
+
+    int first = 1;
+    for (const avr_bench_kernel *kernel = avr_bench_kernels; kernel->name != NULL; kernel++) {
+        avr_bench_result result;
+
+        if (only != NULL && kernel != avr_bench_find(only))
+            continue;
+        if (avr_bench_run(kernel, instructions, repeats, &result) < 0) {
+            perror(kernel->name);
+            return 1;
+        }
+        if (json)
+            print_json(&result, first);
+        else
+            print_text(&result);
+        fflush(stdout);
+        first = 0;
+    }
+
+    if (json)
+        printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,43 @@
+/* State blocks, see avr_block.h */
+
+#include "avr_block.h"
+
+#include <errno.h>
+
+static int
+usable(const void *block, size_t size)
+{
+    return size >= AVR_BLOCK_SIZE && (uintptr_t)block % 8 == 0;
+}
+
+// write the header and a reset state, returns -1 with EINVAL if the block is too small or misaligned
+int
+avr_block_init(void *block, size_t size)
+{
+    if (!usable(block, size)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    avr_block_header *header = block;
+    avr_state_reset(avr_block_state(block));
+    header->size = sizeof(avr_state);
+    header->version = AVR_BLOCK_VERSION;
+    header->magic = AVR_BLOCK_MAGIC;
+    return 0;
+}
+
+// the state of a block written by avr_block_init, NULL with EINVAL if it isn't one of this build
+avr_state *
+avr_block_attach(void *block, size_t size)
+{
+    const avr_block_header *header = block;
+
+    if (!usable(block, size) || header->magic != AVR_BLOCK_MAGIC || header->version != AVR_BLOCK_VERSION
+            || header->size != sizeof(avr_state)
+            || avr_state_check(avr_block_state(block)) < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return avr_block_state(block);
+}
@@ -0,0 +1,35 @@
+#ifndef AVR_BLOCK
+#define AVR_BLOCK
+
+#include "avr_core.h"
+
+/* Machine state in memory owned by someone else, typically shared between processes.
+   A block is a header followed by an avr_state:
+
+       offset  size  field
+       0       4     magic, "AVRS"
+       4       4     version, AVR_BLOCK_VERSION
+       8       8     size of the state that follows, sizeof(avr_state)
+       16            avr_state
+
+   The state holds no pointers, so any process mapping the block can run it in place. Only one
+   board should run a block at a time, other processes may read it. */
+
+#define AVR_BLOCK_MAGIC (0x53525641)
+#define AVR_BLOCK_VERSION (1)
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    size;
+} avr_block_header;
+
+#define AVR_BLOCK_SIZE (sizeof(avr_block_header) + sizeof(avr_state))
+
+// the state starts right after the header, blocks must be 8 byte aligned
+#define avr_block_state(block) ((avr_state *)((avr_block_header *)(block) + 1))
+
+int avr_block_init(void *block, size_t size);
+avr_state *avr_block_attach(void *block, size_t size);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef AVR_CAPI
+#define AVR_CAPI
+
+/* C API of the avr module for other extensions, exported as the capsule avr._C_API.
+
+       const avr_capi *api = avr_capi_import();
+       avr_state *state = api->get_state(board);
+       api->step(board);
+
+   Every function needs the GIL and fails with -1 or NULL and a Python exception set when the
+   object is not a board or the board is running on another thread. io hooks are called from
+   whatever thread runs the board, run_async and run_system do so without the GIL.
+
+   The record log has no room for these accesses. io_read, io_write and restore_snapshot fail
+   with RuntimeError while recording, and writes through get_state must not happen then. What
+   a hook returns is not in any snapshot, so a hook cannot be set while recording or keeping
+   history. record_start, replay, history_start, fault_campaign and validate raise
+   RuntimeError while a hook is set. */
+
+#include "Python.h"
+#include "avr_core.h"
+
+#define AVR_CAPI_NAME "avr._C_API"
+
+// changes when the table or the state layout change incompatibly, new functions are appended
+#define AVR_CAPI_VERSION (1)
+
+typedef struct {
+    int         version;        /* AVR_CAPI_VERSION the module was built with */
+    size_t      size;           /* sizeof the table, later versions may be longer */
+    size_t      snapshot_size;  /* bytes taken by a snapshot, sizeof(avr_state) */
+    PyTypeObject *board_type;
+
+    // the state stays valid while the board is alive, call changed() after writing to it
+    avr_state   *(*get_state)(PyObject *board);
+    int         (*changed)(PyObject *board);
+
+    int         (*step)(PyObject *board);
+    // returns the instructions executed, stops early at BREAK
+    int64_t     (*run)(PyObject *board, uint64_t max_cycles, uint64_t max_instructions);
+
+    // io accesses with the side effects of the firmware doing them
+    int         (*io_read)(PyObject *board, uint8_t address, uint8_t *value);
+    int         (*io_write)(PyObject *board, uint8_t address, uint8_t value);
+
+    // the hook is copied, NULL removes it
+    int         (*set_io_hook)(PyObject *board, const avr_io_hook *hook);
+
+    int         (*take_snapshot)(PyObject *board, void *snapshot);
+    int         (*restore_snapshot)(PyObject *board, const void *snapshot);
+} avr_capi;
+
+// import the table, NULL with ImportError if the module is missing or built for another version
+static inline const avr_capi *
+avr_capi_import(void)
+{
+    const avr_capi *api = PyCapsule_Import(AVR_CAPI_NAME, 0);
+    if (api != NULL && api->version != AVR_CAPI_VERSION) {
+        PyErr_Format(PyExc_ImportError, "avr C API version %d, expected %d", api->version, AVR_CAPI_VERSION);
+        return NULL;
+    }
+    return api;
+}
+
+#endif
@@ -0,0 +1,852 @@
+#include "avr_core.h"
+#include "avr_uart.h"
+#include "avr_spi.h"
+#include "avr_storage.h"
+#include "avr_history.h"
+#include "avr_decode.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define get_bit(n,k) ((n & ( 1 << k )) >> k)
+
+#define g_rd3   (get_bit(rd,3))
+#define g_rr3   (get_bit(rr,3))
+#define g_r3    (get_bit(result,3))
+
+#define g_rd7   (get_bit(rd,7))
+#define g_rr7   (get_bit(rr,7))
+#define g_r7    (get_bit(result,7))
+
+#define x_register ((state->registers[27] << 8) + state->registers[26])
+#define y_register ((state->registers[29] << 8) + state->registers[28])
+#define z_register ((state->registers[31] << 8) + state->registers[30])
+
+#define instr_check(instruction, mask, operation) ((instruction & mask) == operation)
+
+// trace every executed instruction, build with -DAVR_DEBUG to enable
+#ifdef AVR_DEBUG
+#define DEBUG
+#endif
+
+#define NOT_IMPLEMENTED (0)
+#define GENERALIZATION_IMPLEMENTED (0)
+
+
+void
+avr_state_reset(avr_state *state)
+{
+    // registers, io space, sram, flash and counters all start at zero, the eeprom erased
+    memset(state, 0, sizeof(*state));
+
+    avr_uart_reset(state);
+    avr_spi_reset(state);
+    avr_storage_reset(state);
+}
+
+static int
+ring_valid(const avr_ring *ring)
+{
+    return avr_ring_count(ring) <= UART_BUFFER_SIZE;
+}
+
+// 0 if a state from outside, e.g. a snapshot, is safe to run, -1 if its PC or a ring is out of range
+int
+avr_state_check(const avr_state *state)
+{
+    if (state->program_counter >= PROGRAM_MEMORY_SIZE
+            || !ring_valid(&state->uart.rx) || !ring_valid(&state->uart.tx)
+            || !ring_valid(&state->spi.rx) || !ring_valid(&state->spi.tx))
+        return -1;
+    return 0;
+}
+
+void
+avr_core_init(avr_core *core, avr_state *state)
+{
+    memset(core, 0, sizeof(*core));
+    core->state = state;
+    core->uart_tx_fd = -1;
+    core->watch_address = -1;
+}
+
+uint8_t
+avr_io_read(avr_core *core, uint8_t address)
+{
+    if (((core->io_hook.mask >> address) & 1) && core->io_hook.read != NULL)
+        return core->io_hook.read(core->io_hook.context, core, address);
+    if (address == UDR)
+        return avr_uart_read_udr(core);
+    if (address == SPDR)
+        return avr_spi_read_spdr(core);
+    if (address == EECR)
+        return avr_eeprom_read_eecr(core);
+    return core->state->io_registers[address];
+}
+
+void
+avr_io_write(avr_core *core, uint8_t address, uint8_t value)
+{
+    if (core->watch_address == IO_START + address)
+        core->watch_hit = 1;
+    if (((core->io_hook.mask >> address) & 1) && core->io_hook.write != NULL) {
+        core->io_hook.write(core->io_hook.context, core, address, value);
+        return;
+    }
+
+    switch (address) {
+    case UDR:
+        avr_uart_write_udr(core, value);
+        return;
+    case UCSRA: {
+        // only U2X and MPCM are writable, TXC is cleared by writing a one
+        uint8_t ucsra = core->state->io_registers[UCSRA];
+        if (value & (1 << TXC))
+            ucsra &= ~(1 << TXC);
+        core->state->io_registers[UCSRA] = (ucsra & ~UCSRA_WRITABLE) | (value & UCSRA_WRITABLE);
+        break;
+    }
+    case SPDR:
+        avr_spi_write_spdr(core, value);
+        return;
+    case SPSR:
+        // SPIF and WCOL are read only
+        core->state->io_registers[SPSR] = (core->state->io_registers[SPSR] & ~SPSR_WRITABLE) | (value & SPSR_WRITABLE);
+        break;
+    case EECR:
+        avr_eeprom_write_eecr(core, value);
+        return;
+    default:
+        core->state->io_registers[address] = value;
+        break;
+    }
+    core->state->uart.next_event = 0;
+    core->state->spi.next_event = 0;
+}
+
+// values outside the data space read as zero and ignore writes
+uint8_t
+avr_data_read(avr_core *core, uint16_t address)
+{
+    if (address < IO_START)
+        return core->state->registers[address];
+    if (address < SRAM_START)
+        return avr_io_read(core, address - IO_START);
+    if (address < DATA_SIZE)
+        return core->state->sram[address - SRAM_START];
+    return 0;
+}
+
+void
+avr_data_write(avr_core *core, uint16_t address, uint8_t value)
+{
+    if (core->watch_address == address)
+        core->watch_hit = 1;
+
+    if (address < IO_START)
+        core->state->registers[address] = value;
+    else if (address < SRAM_START)
+        avr_io_write(core, address - IO_START, value);
+    else if (address < DATA_SIZE)
+        core->state->sram[address - SRAM_START] = value;
+}
+
+int
+avr_run_instruction(avr_core *core)
+{
+    avr_state *state = core->state;
+    uint16_t pc = state->program_counter;
+
+    // Load instruction from program memory using the program counter
+    uint16_t instruction = state->program_memory[state->program_counter];
+
+    if (instruction == 0){
+        // NOP
+        #ifdef DEBUG
+        printf("NOP\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0001110000000000)){
+        // ADC
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t rr= state->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
+        uint8_t result = rd + rr + get_bit(state->sreg,0);
+
+        // Update SREG
+        uint8_t h = ( g_rd3 & g_rr3 ) | ( g_rr3 & (!g_r3) ) | ( (!g_r3) & g_rd3 );
+        uint8_t v = ( g_rd7 & g_rr7 & (!g_r7) ) | ((!g_rd7) & (!g_rr7) & g_r7);
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t c = ( g_rd7 & g_rr7) | (g_rr7 & (!g_r7)) | ( (!g_r7) & g_rd7 );
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000) | (h << 5) | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1) | c;
+        // Move result to storage
+        state->registers[(instruction & 0b0000000111110000) >> 4] = result;
+
+        #ifdef DEBUG
+        printf("ADC\n");
+        //printf("Rd i: %i\n", (instruction & 0b0000000111110000) >> 4);
+        //printf("Rr i: %i\n", (instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5));
+        //printf("Rd: %i\n",rd);
+        //printf("Rr: %i\n",rr);
+        //printf("Result: %i\n",result);
+        #endif
+
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0000110000000000)){
+        // ADD
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t rr= state->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
+        uint8_t result = rd + rr;
+
+        // Update SREG
+        uint8_t h = ( g_rd3 & g_rr3 ) | ( g_rr3 & (!g_r3) ) | ( (!g_r3) & g_rd3 );
+        uint8_t v = ( g_rd7 & g_rr7 & (!g_r7) ) | ((!g_rd7) & (!g_rr7) & g_r7);
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t c = ( g_rd7 & g_rr7) | (g_rr7 & (!g_r7)) | ( (!g_r7) & g_rd7 );
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000) | (h << 5) | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1) | c;
+
+
+        // Move result to storage
+        state->registers[(instruction & 0b0000000111110000) >> 4] = result;
+
+        #ifdef DEBUG
+        printf("ADD\n");
+        #endif
+
+    }else if(NOT_IMPLEMENTED){
+        // ADIW
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0010000000000000)){
+        // AND
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t rr= state->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
+        uint8_t result = rd & rr;
+
+        // Update SREG
+
+        uint8_t v = 0;
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11100001)  | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1);
+
+
+        state->registers[(instruction & 0b0000000111110000) >> 4] = result;
+
+        #ifdef DEBUG
+        printf("AND\n");
+        #endif
+
+    }else if(instr_check(instruction, 0b1111000000000000, 0b0111000000000000)){
+        // ANDI
+        uint8_t d = 16 + ((instruction & 0b0000000011110000) >> 4);
+        uint8_t rd = state->registers[d] ;
+        uint8_t k = (instruction & 0b0000000000001111) + ((instruction & 0b0000111100000000)>>4);
+        uint8_t result = rd & k;
+
+        // Update SREG
+        uint8_t v = 0;
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11100001)  | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1);
+
+        state->registers[d] = result;
+
+        #ifdef DEBUG
+        printf("ANDI\n");
+        #endif
+
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000101)){
+        // ASR
+        // Signed for arithmetic shift
+        uint8_t rd = state->registers[16 + ((instruction & 0b0000000111110000) >> 4)] ;
+        uint8_t result = rd >> 1;
+
+        // Update SREG
+        uint8_t c = get_bit(rd,0);
+        uint8_t z = result == 0;
+        uint8_t n = g_r7;
+        uint8_t v = n ^ c;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 011100000) | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1) | c;
+
+
+        state->registers[16 + ((instruction & 0b0000000111110000) >> 4)] = result;
+
+        #ifdef DEBUG
+        printf("ASR\n");
+        #endif
+
+    }else if(instr_check(instruction, 0b1111111110001111, 0b1001010010001000)){
+        // BCLR
+        uint8_t position = (instruction & 0b0000000001110000) >> 4;
+        // todo
+        #ifdef DEBUG
+        printf("Sreg = %i\n",state->sreg);
+        #endif
+        state->sreg = ((uint8_t)state->sreg) & ~(1<<position);
+
+        #ifdef DEBUG
+        printf("BCLR\n");
+        #endif
+
+    }else if(instr_check(instruction, 0b1111111000001000, 0b1111100000000000)){
+        // BLD
+        uint8_t position = (instruction & 0b0000000000000111);
+        // todo
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4];
+
+        state->registers[(instruction & 0b0000000111110000) >> 4] = ( (~(1 << position )) & rd) | ((get_bit(state->sreg, 6))<< position);
+
+        #ifdef DEBUG
+        printf("BLD\n");
+        #endif
+
+    }else if(instr_check(instruction, 0b1111110000000000, 0b1111010000000000)){
+        // BRBC
+        uint8_t position = (instruction & 0b0000000000000111);
+        int8_t k = (get_bit(instruction,9)<< 7) | (get_bit(instruction,9)<< 6) | ((instruction & 0b0000000111111000)>>3);
+
+        // todo
+        if(!get_bit(state->sreg,position)){
+            state->program_counter+=k;
+            state->cycles+=1;
+        }
+
+        #ifdef DEBUG
+        printf("BRBC\n");
+        #endif
+
+    }else if(instr_check(instruction, 0b1111110000000000, 0b1111000000000000)){
+        // BRBS
+        uint8_t position = (instruction & 0b0000000000000111);
+        int8_t k = (get_bit(instruction,9)<< 7) | (get_bit(instruction,9)<< 6) | ((instruction & 0b0000000111111000)>>3);
+
+        // todo
+        if(get_bit(state->sreg,position)){
+            state->program_counter+=k;
+            state->cycles+=1;
+        }
+        #ifdef DEBUG
+        printf("BRBS\n");
+        #endif
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRCC
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRCS
+    }else if(instr_check(instruction, 0b1111111111111111, 0b1001010110011000)){
+        // BREAK
+        state->break_point_reached = 1;
+
+        #ifdef DEBUG
+        printf("BREAK\n");
+        #endif
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BREQ
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRGE
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRHC
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRHS
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRID
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRIE
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRLO
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRLT
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRMI
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRNE
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRPL
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRSH
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRTC
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRTS
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRVC
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // BRVS
+    }else if(instr_check(instruction, 0b1111111110001111, 0b1001010000001000)){
+        // BSET
+        uint8_t position = (instruction & 0b0000000001110000) >> 4;
+        // todo
+        state->sreg = (state->sreg) | (1<<position);
+        #ifdef DEBUG
+        printf("BSET\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111000001000, 0b1111101000000000)){
+        // BST
+        uint8_t position = (instruction & 0b0000000000000111);
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4];
+        // todo
+        state->sreg = (state->sreg & 0b10111111) | (get_bit(rd,position)<<6);
+
+        #ifdef DEBUG
+        printf("BST\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // CALL
+    }else if(instr_check(instruction, 0b1111111100000000, 0b1001100000000000)){
+        // CBI
+        uint8_t position = (instruction & 0b0000000000000111);
+        uint8_t sram = state->sram[(instruction & 0b0000000011111000) >> 3];
+        state->sram[(instruction & 0b0000000011111000) >> 3] = sram & (~(1<<position));
+
+        #ifdef DEBUG
+        printf("CBI\n");
+        #endif
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // CBR, see ANDI
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000000)){
+        // COM
+        uint8_t rd = state->registers[((instruction & 0b0000000111110000) >> 4)] ;
+        uint8_t result = 255-rd;
+
+        // Update SREG
+        uint8_t c = 1;
+        uint8_t z = result == 0;
+        uint8_t n = g_r7;
+        uint8_t v = 0;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11101111) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
+
+        state->registers[((instruction & 0b0000000111110000) >> 4)] = result;
+        #ifdef DEBUG
+        printf("COM\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0001010000000000)){
+        // CP
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t rr= state->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
+        uint8_t result = rd - rr;
+
+        // Update SREG
+        uint8_t h = ( (!g_rd3) & g_rr3 ) | ( g_rr3 & g_r3 ) | ( g_r3 & (!g_rd3) );
+        uint8_t v = ( g_rd7 & (!g_rr7) & (!g_r7) ) | ((!g_rd7) & g_rr7 & g_r7);
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t c = ((!g_rd7) & g_rr7) | (g_rr7 & g_r7 ) | ( g_r7 & (!g_rd7) );
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000)  | (h << 5) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
+
+        #ifdef DEBUG
+        printf("CP\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0000010000000000)){
+        // CPC
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t rr= state->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
+        uint8_t result = rd - rr - get_bit(state->sreg,0);
+
+        // Update SREG
+        uint8_t h = ( (!g_rd3) & g_rr3 ) | ( g_rr3 & g_r3 ) | ( g_r3 & (!g_rd3) );
+        uint8_t v = ( g_rd7 & (!g_rr7) & (!g_r7) ) | ((!g_rd7) & g_rr7 & g_r7);
+        uint8_t n = g_r7;
+        uint8_t old_z = get_bit(state->sreg,1);
+        uint8_t z = (result == 0) & old_z;
+        uint8_t c = ((!g_rd7) & g_rr7) | (g_rr7 & g_r7 ) | ( g_r7 & (!g_rd7) );
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000)  | (h << 5) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
+
+
+        #ifdef DEBUG
+        printf("CPC\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111000000000000, 0b0011000000000000)){
+        // CPI
+        uint8_t rd = state->registers[16 + ((instruction & 0b0000000011110000) >> 4)] ;
+        uint8_t k = ((instruction & 0b0000111100000000) >> 4) + (instruction & 0b0000000000001111);
+        uint8_t result = rd - k;
+
+        // Update SREG
+        uint8_t h = ( (!g_rd3) & get_bit(k,3) ) | ( get_bit(k,3) & g_r3 ) | ( g_r3 & (!g_rd3) );
+        uint8_t v = ( g_rd7 & (!g_r7) & (!get_bit(k,7)) ) | ((!g_rd7) & get_bit(k,7) & g_r7);
+        uint8_t n = g_r7;
+        uint8_t old_z = get_bit(state->sreg,1);
+        uint8_t z = (result == 0) & old_z;
+        uint8_t c = ((!g_rd7) & get_bit(k,7)) | (get_bit(k,7) & g_r7 ) | ( g_r7 & (!g_rd7) );
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000)  | (h << 5) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
+
+
+        #ifdef DEBUG
+        printf("CPI\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0001000000000000)){
+        // CPSE
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t rr= state->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
+        uint8_t result = rd - rr;
+
+        if(result == 0){
+            //todo, 2 word instruction check, then program_counter+=2
+            state->program_counter+=1;
+            state->cycles+=1;
+        }
+
+        #ifdef DEBUG
+        printf("CPSE\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000001010)){
+        // DEC
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t result = rd - 1;
+
+        uint8_t v = rd == 128;
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11100001) | (s <<4) | (v <<3) | (n <<2) | (z <<1);
+
+        #ifdef DEBUG
+        printf("DEC\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // DES
+    }else if(NOT_IMPLEMENTED){
+        // EICALL
+    }else if(NOT_IMPLEMENTED){
+        // EIJMP
+    }else if(NOT_IMPLEMENTED){
+        // ELPM
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0010010000000000)){
+        // EOR
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t rr= state->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
+        uint8_t result = rd ^ rr;
+
+        uint8_t v = 0;
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11100001) | (s <<4) | (v <<3) | (n <<2) | (z <<1);
+
+        state->registers[(instruction & 0b0000000111110000) >> 4] = result;
+        #ifdef DEBUG
+        printf("EOR\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // FMUL
+    }else if(NOT_IMPLEMENTED){
+        // FMULS
+    }else if(NOT_IMPLEMENTED){
+        // FMULSU
+    }else if(NOT_IMPLEMENTED){
+        // ICALL
+    }else if(NOT_IMPLEMENTED){
+        // IJMP
+    }else if(instr_check(instruction, 0b1111100000000000, 0b1011000000000000)){
+        // IN
+        uint8_t d = (instruction & 0b0000000111110000) >> 4;
+        uint8_t A  = ((instruction & 0b0000011000000000) >> 5) + (instruction & 0b0000000000001111);
+
+        state->registers[d] = avr_io_read(core, A);
+
+        #ifdef DEBUG
+        printf("IN\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000011)){
+        // INC
+        uint8_t rd = state->registers[(instruction & 0b0000000111110000) >> 4] ;
+        uint8_t result = rd + 1;
+
+        uint8_t v = result == 127;
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000)  | (s << 4) | (v << 3) | (n << 2) | (z << 1);
+
+        state->registers[(instruction & 0b0000000111110000) >> 4] = result;
+        #ifdef DEBUG
+        printf("INC\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // JMP
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001001000000100)){
+        // LAC
+        uint8_t d = (instruction & 0b0000000111110000) >> 4;
+        uint8_t rd = state->registers[d];
+
+        uint16_t z = z_register;
+        uint8_t value = avr_data_read(core, z);
+
+        state->registers[d] = value;
+        avr_data_write(core, z, (255 - rd) & value); //todo, not sure if right
+
+        #ifdef DEBUG
+        printf("LAC\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001001000000101)){
+        // LAS
+        uint8_t d = (instruction & 0b0000000111110000) >> 4;
+        uint8_t rd = state->registers[d];
+
+        uint16_t z = z_register;
+        uint8_t value = avr_data_read(core, z);
+
+        state->registers[d] = value;
+        avr_data_write(core, z, rd | value); //todo, not sure if right
+        #ifdef DEBUG
+        printf("LAS\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001001000000111)){
+        // LAT
+        uint8_t d = (instruction & 0b0000000111110000) >> 4;
+        uint8_t rd = state->registers[d];
+
+        uint16_t z = z_register;
+        uint8_t value = avr_data_read(core, z);
+
+        state->registers[d] = value;
+        avr_data_write(core, z, rd ^ value); //todo, not sure if right
+
+        #ifdef DEBUG
+        printf("LAT\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // LD
+    }else if(instr_check(instruction, 0b1111000000000000, 0b1110000000000000)){
+        // LDI
+        uint8_t d = 16 + ((instruction & 0b0000000011110000) >> 4);
+        uint8_t k = (instruction & 0b0000000000001111) + ((instruction & 0b0000111100000000)>>4);
+
+        state->registers[d] = k;
+        #ifdef DEBUG
+        printf("LDI\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // LDS
+    }else if(NOT_IMPLEMENTED){
+        // LPM
+    }else if(NOT_IMPLEMENTED){
+        // LSL, same as ADD Rd, Rd
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000110)){
+        // LSR
+        uint8_t d = (instruction & 0b0000000111110000) >> 4;
+        uint8_t rd = state->registers[d];
+
+        uint8_t result = rd >> 1 ;
+
+        uint8_t n = 0;
+        uint8_t z = result == 0;
+        uint8_t c = get_bit(rd,0);
+        uint8_t v = n ^ c;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000)  | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
+
+        #ifdef DEBUG
+        printf("LSR\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0010110000000000)){
+        // MOV
+        uint8_t d = (instruction & 0b0000000111110000) >> 4;
+        uint8_t r= (instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5);
+
+        state->registers[d] = state->registers[r];
+
+        #ifdef DEBUG
+        printf("MOV\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // MOVW
+    }else if(NOT_IMPLEMENTED){
+        // MUL
+    }else if(NOT_IMPLEMENTED){
+        // MULS
+    }else if(NOT_IMPLEMENTED){
+        // LMULSU
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000001)){
+        // NEG
+        uint8_t d = (instruction & 0b0000000111110000) >> 4;
+
+        uint8_t rd = state->registers[d];
+
+        uint8_t result = 255 - rd;
+
+        uint8_t h = g_r3 | (!g_rd3);
+        uint8_t v = result == 128;
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t c = result != 0;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000) | (h << 4) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
+
+        state->registers[d] = result;
+
+        #ifdef DEBUG
+        printf("NEG\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0010100000000000)){
+        // OR
+        uint8_t d = (instruction & 0b0000000111110000) >> 4;
+        uint8_t r = (instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5);
+
+        uint8_t rd = state->registers[d];
+        uint8_t rr = state->registers[r];
+
+        uint8_t result = rd | rr;
+
+        uint8_t v = 0;
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t s = n ^ v;
+        state->sreg = (state->sreg & 0b11100001) | (s << 4) | (v << 3) | (n << 2) | (z << 1) ;
+
+        state->registers[d] = result;
+
+        #ifdef DEBUG
+        printf("OR\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111000000000000, 0b0110000000000000)){
+        // ORI
+        #ifdef DEBUG
+        printf("ORI\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111100000000000, 0b1011100000000000)){
+        // OUT
+        uint8_t r = (instruction & 0b0000000111110000) >> 4;
+        uint8_t A  = ((instruction & 0b0000011000000000) >> 5) + (instruction & 0b0000000000001111);
+
+        avr_io_write(core, A, state->registers[r]);
+
+        #ifdef DEBUG
+        printf("OUT\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // POP
+    }else if(NOT_IMPLEMENTED){
+        // PUSH
+    }else if(NOT_IMPLEMENTED){
+        // RCALL
+    }else if(NOT_IMPLEMENTED){
+        // RET
+    }else if(NOT_IMPLEMENTED){
+        // RETI
+    }else if(instr_check(instruction, 0b1111000000000000, 0b1100000000000000)){
+        // RJMP
+        int16_t k = instruction & 0b0000111111111111;
+        if (k & 0b0000100000000000)
+            k -= 4096;
+
+        state->program_counter+=k;
+        state->cycles+=1;
+
+        #ifdef DEBUG
+        printf("RJMP\n");
+        #endif
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // ROL, same as ADC Rd, Rd
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000111)){
+        // ROR
+        #ifdef DEBUG
+        printf("ROR\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0000100000000000)){
+        // SBC
+        #ifdef DEBUG
+        printf("SBC\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111000000000000, 0b0100000000000000)){
+        // SBCI
+        #ifdef DEBUG
+        printf("SBCI\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111100000000, 0b1001101000000000)){
+        // SBI
+        #ifdef DEBUG
+        printf("SBI\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111100000000, 0b1001100100000000)){
+        // SBIC
+        #ifdef DEBUG
+        printf("SBIC\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111100000000, 0b1001101100000000)){
+        // SBIS
+        #ifdef DEBUG
+        printf("SBIS\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // SBIW
+    }else if(GENERALIZATION_IMPLEMENTED){
+        // SBR, ORI Rd, K
+    }else if(instr_check(instruction, 0b1111111000001000, 0b1111110000000000)){
+        // SBRC
+        #ifdef DEBUG
+        printf("SBRC\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111000001000, 0b1111111000000000)){
+        // SBRS
+        #ifdef DEBUG
+        printf("SBRS\n");
+        #endif
+    }else if (GENERALIZATION_IMPLEMENTED){
+        // SER, LDI
+    }else if(instr_check(instruction, 0b1111111111111111, 0b1001010110001000)){
+        // SLEEP
+        #ifdef DEBUG
+        printf("SLEEP\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111111111111, 0b1001010111101000)){
+        // SPM
+        avr_spm(core);
+
+        #ifdef DEBUG
+        printf("SPM\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // ST
+    }else if(NOT_IMPLEMENTED){
+        // STS
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0001100000000000)){
+        // SUB
+        #ifdef DEBUG
+        printf("SUB\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111000000000000, 0b0101000000000000)){
+        // SUBI
+        #ifdef DEBUG
+        printf("SUBI\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000010)){
+        // SWAP
+        #ifdef DEBUG
+        printf("SWAP\n");
+        #endif
+    }else if(instr_check(instruction, 0b1111110000000000, 0b0010000000000000)){
+        // TST
+        #ifdef DEBUG
+        printf("TST\n");
+        #endif
+    }else if(NOT_IMPLEMENTED){
+        // WDR
+    }else if(NOT_IMPLEMENTED){
+        // XCH
+    }
+
+    avr_retire(core, pc);
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+#ifndef AVR_CORE
+#define AVR_CORE
+
+/* Emulator core, plain C without any dependency on Python */
+
+#include <stdint.h>
+#include <string.h>
+
+#define REGISTER_SIZE (32)
+#define IO_REGISTER_SIZE (64)
+#define SRAM_SIZE (1024)
+#define PROGRAM_MEMORY_SIZE (1024)
+#define EEPROM_SIZE (512)
+
+// flash words written by one SPM page write, ATmega8 layout
+#define SPM_PAGE_SIZE (32)
+
+// data space layout: registers, io registers, then sram
+#define IO_START (0x20)
+#define SRAM_START (0x60)
+#define DATA_SIZE (SRAM_START + SRAM_SIZE)
+
+// size of every peripheral byte ring, must be a power of two, the ring indices are free running
+#define UART_BUFFER_SIZE (4096)
+
+// budget value for the run loops meaning no limit
+#define AVR_UNLIMITED (UINT64_MAX)
+
+// AFL compatible edge coverage bitmap
+#define AVR_COVERAGE_MAP_SIZE (65536)
+
+// outcome of avr_fuzz_run
+#define AVR_FUZZ_BREAK (0)
+#define AVR_FUZZ_TIMEOUT (1)
+
+// avr_fuzz_run address meaning the input is fed to the uart receiver
+#define AVR_INPUT_UART (-1)
+
+typedef struct {
+    uint8_t     data[UART_BUFFER_SIZE];
+    uint32_t    head;           /* next write position */
+    uint32_t    tail;           /* next read position */
+} avr_ring;
+
+typedef struct {
+    avr_ring    rx;             /* bytes waiting to be received by the firmware */
+    avr_ring    tx;             /* bytes sent by the firmware */
+    uint64_t    tx_done;        /* cycle at which the transmitter is idle again */
+    uint64_t    rx_ready;       /* cycle at which the next byte may enter UDR */
+    uint64_t    next_event;     /* earliest cycle at which the UART state can change */
+    uint64_t    tx_overruns;    /* bytes dropped because the tx ring was full */
+    uint8_t     rx_data;        /* received byte as seen through UDR */
+} avr_uart;
+
+typedef struct {
+    avr_ring    rx;             /* bytes arriving from the bus, MOSI for a slave and MISO for a master */
+    avr_ring    tx;             /* bytes put on the bus */
+    uint64_t    done;           /* cycle at which the master transfer completes */
+    uint64_t    next_event;     /* earliest cycle at which the SPI state can change */
+    uint8_t     busy;           /* a master transfer is in progress */
+    uint8_t     data;           /* received byte as seen through SPDR */
+    uint8_t     shift;          /* slave shift register, goes back with the next byte of the master */
+    uint8_t     linked;         /* a slave is linked, the master waits for its answer */
+} avr_spi;
+
+typedef struct {
+    uint8_t     data[EEPROM_SIZE];
+    uint64_t    write_done;     /* cycle at which the running write completes */
+    uint64_t    master_until;   /* last cycle at which EEWE starts a write */
+} avr_eeprom;
+
+/* Machine state, plain data without pointers so it can be copied freely */
+typedef struct {
+    uint8_t     sreg;
+    uint8_t     registers[REGISTER_SIZE];
+    uint8_t     io_registers[IO_REGISTER_SIZE];
+    uint8_t     sram[SRAM_SIZE];
+    uint16_t    program_memory[PROGRAM_MEMORY_SIZE];
+    uint16_t    program_counter;
+    uint8_t     break_point_reached;
+    uint64_t    cycles;
+    uint64_t    instructions;   /* instructions retired */
+    avr_uart    uart;
+    avr_spi     spi;
+    avr_eeprom  eeprom;
+    uint16_t    spm_buffer[SPM_PAGE_SIZE]; /* page filled by SPM before it is written */
+} avr_state;
+
+// how a backing file is mapped
+#define AVR_MAP_READ    (0)     /* the file is only read, writes stay in the machine state */
+#define AVR_MAP_WRITE   (1)     /* writes reach the file */
+#define AVR_MAP_COPY    (2)     /* copy on write, writes go to a private copy that is dropped */
+
+typedef struct {
+    uint8_t     *data;          /* the mapped file, NULL if unused */
+    size_t      length;         /* mapped bytes, at most the size of the memory */
+    int         mode;           /* AVR_MAP_* */
+} avr_mapping;
+
+typedef struct avr_log avr_log;
+typedef struct avr_history avr_history;
+typedef struct avr_core avr_core;
+
+/* Peripheral model outside the core. Accesses to the io addresses set in mask go to it instead
+   of the built in handling, read or write may be NULL to leave that direction alone. */
+typedef struct {
+    uint64_t    mask;           /* bit n routes io address n, 0 if unused */
+    void        *context;
+    uint8_t     (*read)(void *context, avr_core *core, uint8_t address);
+    void        (*write)(void *context, avr_core *core, uint8_t address, uint8_t value);
+} avr_io_hook;
+
+// a flash word decoded for avr_run, only used while word still matches the flash
+typedef struct {
+    uint16_t    word;           /* flash word the entry was decoded from */
+    uint8_t     op;             /* handler, 0 is NOP so a zeroed table matches a zeroed flash */
+    uint8_t     fused;          /* handler for this word and the next one, 0 if none */
+    uint8_t     d;              /* destination register or SREG bit */
+    uint8_t     r;              /* source register, constant or branch condition */
+    int16_t     k;              /* jump offset */
+} avr_decoded;
+
+/* Host side of an emulated MCU, everything that is not machine state */
+struct avr_core {
+    avr_state   *state;
+    int         uart_tx_fd;     /* stream uart tx to this descriptor, -1 if unused */
+    uint8_t     uart_tx_drain;  /* without a descriptor, drop a full tx ring as a flush would */
+    uint8_t     *coverage_map;  /* AVR_COVERAGE_MAP_SIZE edge counters, NULL if unused */
+    avr_log     *record;        /* host inputs are appended here, NULL if not recording */
+    avr_history *history;       /* checkpoints for reverse execution, NULL if unused */
+    int32_t     watch_address;  /* data address whose stores set watch_hit, -1 if unused */
+    uint8_t     watch_hit;
+    avr_mapping flash_file;     /* file behind the program memory */
+    avr_mapping eeprom_file;    /* file behind the eeprom */
+    avr_io_hook io_hook;
+    avr_decoded decoded[PROGRAM_MEMORY_SIZE];
+};
+
+typedef struct {
+    uint64_t    cycles;
+    uint64_t    batches;
+    uint64_t    overruns;       /* batches that finished after their deadline */
+    uint64_t    max_overrun_ns;
+    uint64_t    total_jitter_ns;
+    uint64_t    max_jitter_ns;
+    uint64_t    elapsed_ns;
+} avr_pacing_stats;
+
+#define avr_ring_count(ring) ((uint32_t)((ring)->head - (ring)->tail))
+#define avr_ring_free(ring) (UART_BUFFER_SIZE - avr_ring_count(ring))
+#define avr_ring_index(position) ((position) & (UART_BUFFER_SIZE - 1))
+
+// copy up to length bytes into the ring, returns the number of bytes copied
+static inline uint32_t
+avr_ring_push(avr_ring *ring, const uint8_t *data, uint32_t length)
+{
+    uint32_t free = avr_ring_free(ring);
+    if (length > free)
+        length = free;
+
+    uint32_t start = avr_ring_index(ring->head);
+    uint32_t first = UART_BUFFER_SIZE - start;
+    if (first > length)
+        first = length;
+
+    memcpy(&ring->data[start], data, first);
+    memcpy(&ring->data[0], data + first, length - first);
+    ring->head += length;
+    return length;
+}
+
+// copy up to length bytes out of the ring, returns the number of bytes copied
+static inline uint32_t
+avr_ring_pop(avr_ring *ring, uint8_t *data, uint32_t length)
+{
+    uint32_t count = avr_ring_count(ring);
+    if (length > count)
+        length = count;
+
+    uint32_t start = avr_ring_index(ring->tail);
+    uint32_t first = UART_BUFFER_SIZE - start;
+    if (first > length)
+        first = length;
+
+    memcpy(data, &ring->data[start], first);
+    memcpy(data + first, &ring->data[0], length - first);
+    ring->tail += length;
+    return length;
+}
+
+void avr_state_reset(avr_state *state);
+int avr_state_check(const avr_state *state);
+void avr_core_init(avr_core *core, avr_state *state);
+
+uint8_t avr_io_read(avr_core *core, uint8_t address);
+void avr_io_write(avr_core *core, uint8_t address, uint8_t value);
+uint8_t avr_data_read(avr_core *core, uint16_t address);
+void avr_data_write(avr_core *core, uint16_t address, uint8_t value);
+
+int avr_run_instruction(avr_core *core);
+uint64_t avr_run(avr_core *core, uint64_t max_cycles, uint64_t max_instructions);
+
+uint64_t avr_monotonic_ns(void);
+void avr_sleep_until(uint64_t deadline, uint64_t spin_ns);
+int avr_run_paced(avr_core *core, uint64_t cycles, double frequency, uint64_t batch_cycles,
+                  uint64_t spin_ns, avr_pacing_stats *stats);
+
+int avr_load_image(avr_state *state, const char *path);
+
+int avr_fuzz_run(avr_core *core, const avr_state *start, const uint8_t *input, size_t length,
+                 int32_t address, uint64_t max_cycles);
+
+#endif
@@ -0,0 +1,350 @@
+/* Pre-decoded interpreter, see avr_decode.h. The handlers repeat the semantics of
+   avr_run_instruction flag for flag, anything not handled here runs through it. */
+
+#include "avr_decode.h"
+
+#define get_bit(n,k) ((n & ( 1 << k )) >> k)
+
+#define g_rd3   (get_bit(rd,3))
+#define g_rr3   (get_bit(rr,3))
+#define g_r3    (get_bit(result,3))
+
+#define g_rd7   (get_bit(rd,7))
+#define g_rr7   (get_bit(rr,7))
+#define g_r7    (get_bit(result,7))
+
+enum {
+    OP_NOP = 0,
+    OP_SLOW,                    /* avr_run_instruction */
+    OP_ADC,
+    OP_ADD,
+    OP_AND,
+    OP_ANDI,
+    OP_BRANCH,                  /* BRBS and BRBC, taken when SREG bit d equals r */
+    OP_CP,
+    OP_CPC,
+    OP_CPI,
+    OP_DEC,
+    OP_EOR,
+    OP_INC,
+    OP_LDI,
+    OP_MOV,
+    OP_OR,
+    OP_RJMP,
+};
+
+// pairs compiled code is full of, the first half never changes the flow or touches memory
+enum {
+    FUSED_NONE = 0,
+    FUSED_CP_BRANCH,
+    FUSED_CPC_BRANCH,
+    FUSED_CPI_BRANCH,
+    FUSED_DEC_BRANCH,           /* counted loops, DEC then BRNE */
+    FUSED_LDI_LDI,              /* 16 bit constants */
+    FUSED_ADD_ADC,              /* 16 bit additions */
+};
+
+static uint8_t
+fuse(const avr_decoded *first, const avr_decoded *second)
+{
+    if (second->op == OP_BRANCH) {
+        switch (first->op) {
+        case OP_CP: return FUSED_CP_BRANCH;
+        case OP_CPC: return FUSED_CPC_BRANCH;
+        case OP_CPI: return FUSED_CPI_BRANCH;
+        case OP_DEC: return FUSED_DEC_BRANCH;
+        }
+    }
+    if (first->op == OP_LDI && second->op == OP_LDI)
+        return FUSED_LDI_LDI;
+    if (first->op == OP_ADD && second->op == OP_ADC)
+        return FUSED_ADD_ADC;
+    return FUSED_NONE;
+}
+
+// same masks as avr_run_instruction, none of its earlier checks matches these words
+static void
+decode_word(avr_decoded *decoded, uint16_t word)
+{
+    memset(decoded, 0, sizeof(*decoded));
+    decoded->word = word;
+    decoded->op = OP_SLOW;
+
+    uint8_t d = (word & 0b0000000111110000) >> 4;
+    uint8_t r = (word & 0b0000000000001111) + ((word & 0b0000001000000000) >> 5);
+    uint8_t d_high = 16 + ((word & 0b0000000011110000) >> 4);
+    uint8_t k = ((word & 0b0000111100000000) >> 4) + (word & 0b0000000000001111);
+
+    if (word == 0) {
+        decoded->op = OP_NOP;
+    } else if ((word & 0b1111000000000000) == 0b1110000000000000) {
+        *decoded = (avr_decoded){word, OP_LDI, 0, d_high, k, 0};
+    } else if ((word & 0b1111000000000000) == 0b0011000000000000) {
+        *decoded = (avr_decoded){word, OP_CPI, 0, d_high, k, 0};
+    } else if ((word & 0b1111000000000000) == 0b0111000000000000) {
+        *decoded = (avr_decoded){word, OP_ANDI, 0, d_high, k, 0};
+    } else if ((word & 0b1111000000000000) == 0b1100000000000000) {
+        int16_t offset = word & 0b0000111111111111;
+        if (offset & 0b0000100000000000)
+            offset -= 4096;
+        *decoded = (avr_decoded){word, OP_RJMP, 0, 0, 0, offset};
+    } else if ((word & 0b1111100000000000) == 0b1111000000000000) {
+        // BRBS when bit 10 is clear, BRBC when it is set
+        int8_t offset = (get_bit(word,9)<< 7) | (get_bit(word,9)<< 6) | ((word & 0b0000000111111000)>>3);
+        *decoded = (avr_decoded){word, OP_BRANCH, 0, word & 0b111, !(word & 0b0000010000000000), offset};
+    } else {
+        static const struct { uint16_t mask, operation; uint8_t op; } two_register[] = {
+            {0b1111110000000000, 0b0001110000000000, OP_ADC},
+            {0b1111110000000000, 0b0000110000000000, OP_ADD},
+            {0b1111110000000000, 0b0010000000000000, OP_AND},
+            {0b1111110000000000, 0b0001010000000000, OP_CP},
+            {0b1111110000000000, 0b0000010000000000, OP_CPC},
+            {0b1111111000001111, 0b1001010000001010, OP_DEC},
+            {0b1111110000000000, 0b0010010000000000, OP_EOR},
+            {0b1111111000001111, 0b1001010000000011, OP_INC},
+            {0b1111110000000000, 0b0010110000000000, OP_MOV},
+            {0b1111110000000000, 0b0010100000000000, OP_OR},
+        };
+        for (size_t i = 0; i < sizeof(two_register) / sizeof(two_register[0]); i++) {
+            if ((word & two_register[i].mask) == two_register[i].operation) {
+                *decoded = (avr_decoded){word, two_register[i].op, 0, d, r, 0};
+                break;
+            }
+        }
+    }
+}
+
+// decode the word at address again, the pair ending there may change as well
+void
+avr_decode(avr_core *core, uint16_t address)
+{
+    avr_decoded *decoded = core->decoded;
+
+    decode_word(&decoded[address], core->state->program_memory[address]);
+    if (address + 1 < PROGRAM_MEMORY_SIZE)
+        decoded[address].fused = fuse(&decoded[address], &decoded[address + 1]);
+    if (address > 0)
+        decoded[address - 1].fused = fuse(&decoded[address - 1], &decoded[address]);
+}
+
+static inline void
+add(avr_state *state, const avr_decoded *decoded, uint8_t carry)
+{
+    uint8_t rd = state->registers[decoded->d];
+    uint8_t rr = state->registers[decoded->r];
+    uint8_t result = rd + rr + carry;
+
+    uint8_t h = ( g_rd3 & g_rr3 ) | ( g_rr3 & (!g_r3) ) | ( (!g_r3) & g_rd3 );
+    uint8_t v = ( g_rd7 & g_rr7 & (!g_r7) ) | ((!g_rd7) & (!g_rr7) & g_r7);
+    uint8_t n = g_r7;
+    uint8_t z = result == 0;
+    uint8_t c = ( g_rd7 & g_rr7) | (g_rr7 & (!g_r7)) | ( (!g_r7) & g_rd7 );
+    uint8_t s = n ^ v;
+
+    state->sreg = (state->sreg & 0b11000000) | (h << 5) | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1) | c;
+    state->registers[decoded->d] = result;
+}
+
+// CP, CPC and CPI, the carry versions keep Z only if it was set
+static inline void
+compare(avr_state *state, uint8_t rd, uint8_t rr, uint8_t carry, uint8_t chain)
+{
+    uint8_t result = rd - rr - carry;
+
+    uint8_t h = ( (!g_rd3) & g_rr3 ) | ( g_rr3 & g_r3 ) | ( g_r3 & (!g_rd3) );
+    uint8_t v = ( g_rd7 & (!g_rr7) & (!g_r7) ) | ((!g_rd7) & g_rr7 & g_r7);
+    uint8_t n = g_r7;
+    uint8_t z = chain ? (result == 0) & get_bit(state->sreg,1) : result == 0;
+    uint8_t c = ((!g_rd7) & g_rr7) | (g_rr7 & g_r7 ) | ( g_r7 & (!g_rd7) );
+    uint8_t s = n ^ v;
+
+    state->sreg = (state->sreg & 0b11000000)  | (h << 5) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
+}
+
+// AND, ANDI, EOR and OR
+static inline void
+logic(avr_state *state, uint8_t d, uint8_t result)
+{
+    uint8_t v = 0;
+    uint8_t n = g_r7;
+    uint8_t z = result == 0;
+    uint8_t s = n ^ v;
+
+    state->sreg = (state->sreg & 0b11100001) | (s << 4) | (v << 3) | (n << 2) | (z << 1);
+    state->registers[d] = result;
+}
+
+// DEC sets the flags but, like avr_run_instruction, does not store the result
+static inline void
+dec(avr_state *state, const avr_decoded *decoded)
+{
+    uint8_t rd = state->registers[decoded->d];
+    uint8_t result = rd - 1;
+
+    uint8_t v = rd == 128;
+    uint8_t n = g_r7;
+    uint8_t z = result == 0;
+    uint8_t s = n ^ v;
+
+    state->sreg = (state->sreg & 0b11100001) | (s <<4) | (v <<3) | (n <<2) | (z <<1);
+}
+
+static inline void
+branch(avr_state *state, const avr_decoded *decoded)
+{
+    if (get_bit(state->sreg,decoded->d) == decoded->r) {
+        state->program_counter+=decoded->k;
+        state->cycles+=1;
+    }
+}
+
+static inline void
+execute(avr_core *core, const avr_decoded *decoded)
+{
+    avr_state *state = core->state;
+    uint16_t pc = state->program_counter;
+    uint8_t *registers = state->registers;
+
+    switch (decoded->op) {
+    case OP_NOP:
+        break;
+    case OP_SLOW:
+        avr_run_instruction(core);
+        return;
+    case OP_ADC:
+        add(state, decoded, get_bit(state->sreg,0));
+        break;
+    case OP_ADD:
+        add(state, decoded, 0);
+        break;
+    case OP_AND:
+        logic(state, decoded->d, registers[decoded->d] & registers[decoded->r]);
+        break;
+    case OP_ANDI:
+        logic(state, decoded->d, registers[decoded->d] & decoded->r);
+        break;
+    case OP_BRANCH:
+        branch(state, decoded);
+        break;
+    case OP_CP:
+        compare(state, registers[decoded->d], registers[decoded->r], 0, 0);
+        break;
+    case OP_CPC:
+        compare(state, registers[decoded->d], registers[decoded->r], get_bit(state->sreg,0), 1);
+        break;
+    case OP_CPI:
+        compare(state, registers[decoded->d], decoded->r, 0, 1);
+        break;
+    case OP_DEC:
+        dec(state, decoded);
+        break;
+    case OP_EOR:
+        logic(state, decoded->d, registers[decoded->d] ^ registers[decoded->r]);
+        break;
+    case OP_INC: {
+        uint8_t result = registers[decoded->d] + 1;
+
+        uint8_t v = result == 127;
+        uint8_t n = g_r7;
+        uint8_t z = result == 0;
+        uint8_t s = n ^ v;
+
+        state->sreg = (state->sreg & 0b11000000)  | (s << 4) | (v << 3) | (n << 2) | (z << 1);
+        registers[decoded->d] = result;
+        break;
+    }
+    case OP_LDI:
+        registers[decoded->d] = decoded->r;
+        break;
+    case OP_MOV:
+        registers[decoded->d] = registers[decoded->r];
+        break;
+    case OP_OR:
+        logic(state, decoded->d, registers[decoded->d] | registers[decoded->r]);
+        break;
+    case OP_RJMP:
+        state->program_counter+=decoded->k;
+        state->cycles+=1;
+        break;
+    }
+    avr_retire(core, pc);
+}
+
+// both halves retire on their own, ticks and coverage see the same sequence as single steps
+static inline void
+execute_fused(avr_core *core, const avr_decoded *first)
+{
+    avr_state *state = core->state;
+    const avr_decoded *second = first + 1;
+    uint16_t pc = state->program_counter;
+    uint8_t *registers = state->registers;
+
+    switch (first->fused) {
+    case FUSED_CP_BRANCH:
+        compare(state, registers[first->d], registers[first->r], 0, 0);
+        break;
+    case FUSED_CPC_BRANCH:
+        compare(state, registers[first->d], registers[first->r], get_bit(state->sreg,0), 1);
+        break;
+    case FUSED_CPI_BRANCH:
+        compare(state, registers[first->d], first->r, 0, 1);
+        break;
+    case FUSED_DEC_BRANCH:
+        dec(state, first);
+        break;
+    case FUSED_LDI_LDI:
+        registers[first->d] = first->r;
+        avr_retire(core, pc);
+        registers[second->d] = second->r;
+        avr_retire(core, pc + 1);
+        return;
+    case FUSED_ADD_ADC:
+        add(state, first, 0);
+        avr_retire(core, pc);
+        add(state, second, get_bit(state->sreg,0));
+        avr_retire(core, pc + 1);
+        return;
+    }
+    avr_retire(core, pc);
+    branch(state, second);
+    avr_retire(core, pc + 1);
+}
+
+// run until BREAK or until one of the budgets is used up, returns the instructions executed
+uint64_t
+avr_run(avr_core *core, uint64_t max_cycles, uint64_t max_instructions)
+{
+    avr_state *state = core->state;
+    uint64_t end_cycle = state->cycles + max_cycles;
+    uint64_t end_instruction = state->instructions + max_instructions;
+    uint64_t start_instruction = state->instructions;
+
+    if (end_cycle < state->cycles)
+        end_cycle = AVR_UNLIMITED;
+    if (end_instruction < state->instructions)
+        end_instruction = AVR_UNLIMITED;
+
+    while (!state->break_point_reached && state->cycles < end_cycle && state->instructions < end_instruction) {
+        #ifdef AVR_DEBUG
+        // the trace is printed by avr_run_instruction
+        avr_run_instruction(core);
+        continue;
+        #endif
+
+        uint16_t pc = state->program_counter;
+        avr_decoded *decoded = &core->decoded[pc];
+
+        if (decoded->word != state->program_memory[pc])
+            avr_decode(core, pc);
+
+        // a pair only runs as one if the loop would not have stopped after its first half
+        if (decoded->fused != FUSED_NONE
+                && decoded[1].word == state->program_memory[pc + 1]
+                && state->cycles + 1 < end_cycle && state->instructions + 1 < end_instruction)
+            execute_fused(core, decoded);
+        else
+            execute(core, decoded);
+    }
+
+    return state->instructions - start_instruction;
+}
@@ -0,0 +1,44 @@
+#ifndef AVR_DECODE
+#define AVR_DECODE
+
+#include "avr_core.h"
+#include "avr_uart.h"
+#include "avr_spi.h"
+#include "avr_history.h"
+
+/* Pre-decoded interpreter behind avr_run. Flash words are decoded once into core->decoded and
+   common pairs are run as one handler, everything else goes through avr_run_instruction. An
+   entry is decoded again as soon as its flash word differs, so every way of changing the flash,
+   including copying whole states, invalidates it. */
+
+// AFL style edge counter, the source is shifted so that A->B and B->A differ
+static inline void
+avr_coverage_edge(avr_core *core, uint16_t from, uint16_t to)
+{
+    uint16_t from_location = (uint16_t)((from * 0x9E37u) ^ (from >> 3));
+    uint16_t to_location = (uint16_t)((to * 0x9E37u) ^ (to >> 3));
+    core->coverage_map[(from_location >> 1) ^ to_location] += 1;
+}
+
+// end of every instruction, pc is where it started
+static inline void
+avr_retire(avr_core *core, uint16_t pc)
+{
+    avr_state *state = core->state;
+
+    // the program counter wraps around at the end of the flash
+    uint16_t next = (state->program_counter + 1) % PROGRAM_MEMORY_SIZE;
+    if (core->coverage_map != NULL && next != (pc + 1) % PROGRAM_MEMORY_SIZE)
+        avr_coverage_edge(core, pc, next);
+    state->program_counter = next;
+    state->cycles+=1;
+    state->instructions+=1;
+
+    avr_uart_tick(core);
+    avr_spi_tick(core);
+    avr_history_tick(core);
+}
+
+void avr_decode(avr_core *core, uint16_t address);
+
+#endif
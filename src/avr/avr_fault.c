@@ -0,0 +1,193 @@
+/* Fault injection campaigns, see avr_fault.h */
+
+#include "avr_fault.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    const avr_state *start;
+    const avr_state *golden;
+    const avr_fault *faults;
+    size_t          count;
+    uint16_t        code_words;
+    uint64_t        max_cycles;
+    uint8_t         *outcomes;
+    size_t          next;           /* next fault to run, shared by the workers */
+    size_t          done;           /* faults classified */
+} campaign;
+
+static int
+valid_fault(const avr_fault *fault)
+{
+    switch (fault->target) {
+    case AVR_FAULT_REGISTER:
+        return fault->address < REGISTER_SIZE && fault->mask <= 0xFF;
+    case AVR_FAULT_SREG:
+        return fault->mask <= 0xFF;
+    case AVR_FAULT_SRAM:
+        return fault->address < SRAM_SIZE && fault->mask <= 0xFF;
+    case AVR_FAULT_FLASH:
+        return fault->address < PROGRAM_MEMORY_SIZE;
+    }
+    return 0;
+}
+
+void
+avr_fault_inject(avr_state *state, const avr_fault *fault)
+{
+    switch (fault->target) {
+    case AVR_FAULT_REGISTER:
+        state->registers[fault->address] ^= fault->mask;
+        break;
+    case AVR_FAULT_SREG:
+        state->sreg ^= fault->mask;
+        break;
+    case AVR_FAULT_SRAM:
+        state->sram[fault->address] ^= fault->mask;
+        break;
+    case AVR_FAULT_FLASH:
+        state->program_memory[fault->address] ^= fault->mask;
+        break;
+    }
+}
+
+static int
+same_output(const avr_ring *a, const avr_ring *b)
+{
+    uint32_t count = avr_ring_count(a);
+    if (count != avr_ring_count(b))
+        return 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (a->data[avr_ring_index(a->tail + i)] != b->data[avr_ring_index(b->tail + i)])
+            return 0;
+    }
+    return 1;
+}
+
+// the result of a run is what the firmware computed and sent, timing and io flags don't count
+static int
+same_result(const avr_state *a, const avr_state *b)
+{
+    return a->sreg == b->sreg
+        && memcmp(a->registers, b->registers, REGISTER_SIZE) == 0
+        && memcmp(a->sram, b->sram, SRAM_SIZE) == 0
+        && same_output(&a->uart.tx, &b->uart.tx);
+}
+
+static uint8_t
+run_fault(const campaign *c, avr_core *core, const avr_fault *fault)
+{
+    avr_state *state = core->state;
+    uint64_t start = c->start->cycles;
+
+    memcpy(state, c->start, sizeof(avr_state));
+
+    // up to the injection the run is the golden one, no checks needed
+    if (fault->cycle > 0)
+        avr_run(core, fault->cycle < c->max_cycles ? fault->cycle : c->max_cycles, AVR_UNLIMITED);
+    if (state->break_point_reached)
+        return AVR_OUTCOME_MASKED;
+    avr_fault_inject(state, fault);
+
+    while (!state->break_point_reached) {
+        if (state->program_counter >= c->code_words)
+            return AVR_OUTCOME_CRASH;
+        if (state->cycles - start >= c->max_cycles)
+            return AVR_OUTCOME_HANG;
+        avr_run_instruction(core);
+    }
+    return same_result(state, c->golden) ? AVR_OUTCOME_MASKED : AVR_OUTCOME_SDC;
+}
+
+// a worker that can't get its state leaves the faults to the others
+static void *
+worker(void *arg)
+{
+    campaign *c = arg;
+    avr_state *state = malloc(sizeof(avr_state));
+    avr_core core;
+
+    if (state == NULL)
+        return NULL;
+    avr_core_init(&core, state);
+
+    for (;;) {
+        size_t index = __atomic_fetch_add(&c->next, 1, __ATOMIC_RELAXED);
+        if (index >= c->count)
+            break;
+        c->outcomes[index] = run_fault(c, &core, &c->faults[index]);
+        __atomic_fetch_add(&c->done, 1, __ATOMIC_RELAXED);
+    }
+    free(state);
+    return NULL;
+}
+
+// run every fault from start on threads workers, 0 for one per cpu, and store one
+// AVR_OUTCOME_* per fault. The golden run has to reach BREAK inside the code within
+// max_cycles, otherwise the campaign fails with EINVAL. Returns -1 with errno set on failure.
+int
+avr_fault_campaign(const avr_state *start, const avr_fault *faults, size_t count, uint16_t code_words,
+                   uint64_t max_cycles, int threads, uint8_t *outcomes)
+{
+    campaign c = {start, NULL, faults, count, code_words, max_cycles, outcomes, 0, 0};
+    avr_state *golden;
+    avr_core core;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!valid_fault(&faults[i])) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    golden = malloc(sizeof(avr_state));
+    if (golden == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(golden, start, sizeof(avr_state));
+    avr_core_init(&core, golden);
+    while (!golden->break_point_reached && golden->cycles - start->cycles < max_cycles
+            && golden->program_counter < code_words)
+        avr_run_instruction(&core);
+    if (!golden->break_point_reached) {
+        free(golden);
+        errno = EINVAL;
+        return -1;
+    }
+    c.golden = golden;
+
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+    if ((size_t)threads > count)
+        threads = count ? (int)count : 1;
+
+    pthread_t *ids = malloc(threads * sizeof(pthread_t));
+    if (ids == NULL) {
+        free(golden);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    int started = 0;
+    while (started < threads && pthread_create(&ids[started], NULL, worker, &c) == 0)
+        started++;
+    // run on the calling thread if no worker could be started
+    if (started == 0)
+        worker(&c);
+    for (int i = 0; i < started; i++)
+        pthread_join(ids[i], NULL);
+
+    free(ids);
+    free(golden);
+    if (c.done < count) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef AVR_FAULT
+#define AVR_FAULT
+
+#include "avr_core.h"
+
+#include <stddef.h>
+
+/* Fault injection campaigns. Every fault is a bit flip applied to its own copy of a start
+   state, the run is then classified against a golden run without fault. */
+
+// fault targets
+#define AVR_FAULT_REGISTER  (0)     /* address is the register index */
+#define AVR_FAULT_SREG      (1)     /* address is ignored */
+#define AVR_FAULT_SRAM      (2)     /* address is the sram offset */
+#define AVR_FAULT_FLASH     (3)     /* address is the flash word, the mask may use 16 bits */
+
+// outcomes
+#define AVR_OUTCOME_MASKED  (0)     /* reached BREAK with the golden result */
+#define AVR_OUTCOME_CRASH   (1)     /* executed outside the code */
+#define AVR_OUTCOME_HANG    (2)     /* no BREAK within the cycle budget */
+#define AVR_OUTCOME_SDC     (3)     /* reached BREAK with a different result */
+
+typedef struct {
+    uint64_t    cycle;          /* cycles after the start, applied at the next instruction boundary */
+    uint8_t     target;
+    uint16_t    address;
+    uint16_t    mask;           /* bits to flip */
+} avr_fault;
+
+void avr_fault_inject(avr_state *state, const avr_fault *fault);
+int avr_fault_campaign(const avr_state *start, const avr_fault *faults, size_t count, uint16_t code_words,
+                       uint64_t max_cycles, int threads, uint8_t *outcomes);
+
+#endif
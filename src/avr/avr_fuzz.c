@@ -0,0 +1,31 @@
+/* Fuzzing support, one input per run from a snapshot of the machine state */
+
+#include "avr_core.h"
+#include "avr_history.h"
+#include "avr_uart.h"
+
+// restore the start state, place the input and run until BREAK or the cycle budget runs out.
+// The input goes to the uart receiver for AVR_INPUT_UART, otherwise it is copied into the data
+// space from the given address on, in both cases it is truncated to what fits. The coverage map
+// is not cleared, that is up to the caller.
+int
+avr_fuzz_run(avr_core *core, const avr_state *start, const uint8_t *input, size_t length,
+             int32_t address, uint64_t max_cycles)
+{
+    avr_state *state = core->state;
+
+    if (state != start)
+        memcpy(state, start, sizeof(*state));
+
+    if (address == AVR_INPUT_UART) {
+        avr_uart_rx_push(state, input, length > UART_BUFFER_SIZE ? UART_BUFFER_SIZE : (uint32_t)length);
+    } else {
+        for (size_t i = 0; i < length && address + i < DATA_SIZE; i++)
+            avr_data_write(core, (uint16_t)(address + i), input[i]);
+    }
+    // the input is a host change, replays start after it
+    avr_history_mark(core);
+
+    avr_run(core, max_cycles, AVR_UNLIMITED);
+    return state->break_point_reached ? AVR_FUZZ_BREAK : AVR_FUZZ_TIMEOUT;
+}
@@ -4,21 +4,22 @@
 #include <stdint.h>
 #include <string.h>
 
-#define REGISTER_SIZE (32)
-#define IO_REGISTER_SIZE (64)
-#define SRAM_SIZE (1024)
-#define PROGRAM_MEMORY_SIZE (1024)
+#include "avr_core.h"
+#include "avr_replay.h"
+#include "avr_history.h"
 
 typedef struct {
     PyObject_HEAD
-    uint8_t     sreg;
-    uint8_t     registers[REGISTER_SIZE];
-    uint8_t     io_registers[IO_REGISTER_SIZE];
-    uint8_t     sram[SRAM_SIZE];
-    uint16_t    program_memory[PROGRAM_MEMORY_SIZE];
-    uint16_t    program_counter;
-    uint8_t     break_point_reached;
+    avr_core    core;
+    avr_state   state;
+    uint8_t     running;        /* state is owned by a run without the GIL */
+    PyObject    *async_future;  /* future of the running worker, NULL when idle */
+    int         async_cancel;   /* set to stop the worker at the next slice, __atomic accesses only */
+    Py_buffer   coverage;       /* exported coverage map, coverage.obj is NULL if unused */
+    Py_buffer   block;          /* state block core.state points into, block.obj is NULL for state */
+    avr_log     record;         /* input log, in use while core.record points here */
+    avr_history history;        /* checkpoints, in use while core.history points here */
     PyObject    *x_attr;        /* Attributes dictionary */
 } AVRoObject;
 
-#endif
\ No newline at end of file
+#endif
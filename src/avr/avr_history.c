@@ -0,0 +1,291 @@
+/* Reverse execution from periodic checkpoints, see avr_history.h */
+
+#include "avr_history.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+static void
+truncate_history(avr_history *history, size_t count)
+{
+    while (history->count > count)
+        free(history->checkpoints[--history->count]);
+}
+
+// copy the state to the end of the history, recycling the oldest checkpoint at the limit
+static int
+append(avr_history *history, const avr_state *state)
+{
+    avr_state *checkpoint;
+
+    if (history->limit && history->count == history->limit) {
+        checkpoint = history->checkpoints[0];
+        memmove(history->checkpoints, history->checkpoints + 1, (history->count - 1) * sizeof(avr_state *));
+        history->count -= 1;
+    } else {
+        if (history->count == history->capacity) {
+            size_t capacity = history->capacity ? 2 * history->capacity : 16;
+            avr_state **checkpoints = realloc(history->checkpoints, capacity * sizeof(avr_state *));
+            if (checkpoints == NULL)
+                return -1;
+            history->checkpoints = checkpoints;
+            history->capacity = capacity;
+        }
+        checkpoint = malloc(sizeof(avr_state));
+        if (checkpoint == NULL)
+            return -1;
+    }
+    memcpy(checkpoint, state, sizeof(avr_state));
+    history->checkpoints[history->count++] = checkpoint;
+    return 0;
+}
+
+// keep checkpoints every interval cycles from now on, returns -1 with errno set
+int
+avr_history_start(avr_core *core, avr_history *history, uint64_t interval, size_t limit)
+{
+    if (interval == 0 || limit == 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(history, 0, sizeof(*history));
+    history->interval = interval;
+    history->limit = limit;
+    history->scratch = malloc(sizeof(avr_state));
+    if (history->scratch == NULL || append(history, core->state) < 0) {
+        free(history->scratch);
+        free(history->checkpoints);
+        errno = ENOMEM;
+        return -1;
+    }
+    history->next_checkpoint = core->state->cycles + interval;
+    core->history = history;
+    return 0;
+}
+
+void
+avr_history_stop(avr_core *core)
+{
+    avr_history *history = core->history;
+    if (history == NULL)
+        return;
+
+    truncate_history(history, 0);
+    free(history->checkpoints);
+    free(history->scratch);
+    memset(history, 0, sizeof(*history));
+    core->history = NULL;
+}
+
+// a lost checkpoint would let a replay run across a host change, so a failure drops the
+// whole history and the queries report ENOMEM from then on
+void
+avr_history_checkpoint(avr_core *core)
+{
+    avr_history *history = core->history;
+
+    if (history->failed || append(history, core->state) < 0) {
+        truncate_history(history, 0);
+        history->failed = 1;
+        history->next_checkpoint = AVR_UNLIMITED;
+        return;
+    }
+    history->next_checkpoint = core->state->cycles + history->interval;
+}
+
+// the host changed the state, replays must not run across this point
+void
+avr_history_mark(avr_core *core)
+{
+    avr_history *history = core->history;
+    if (history == NULL || history->failed)
+        return;
+
+    if (history->count > 0) {
+        uint64_t last = history->checkpoints[history->count - 1]->instructions;
+        if (last > core->state->instructions)
+            truncate_history(history, 0);   /* the state jumped to another timeline */
+        else if (last == core->state->instructions)
+            truncate_history(history, history->count - 1);
+    }
+    avr_history_checkpoint(core);
+}
+
+/* Queries */
+
+static int
+check_history(avr_history *history)
+{
+    if (history == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (history->failed) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+// copy checkpoint index into the scratch state and set up a core without host side effects for it,
+// a streaming core had its full tx ring flushed, so the replay drops it at the same points
+static void
+load_scratch(avr_core *core, size_t index, avr_core *scratch)
+{
+    avr_history *history = core->history;
+
+    memcpy(history->scratch, history->checkpoints[index], sizeof(avr_state));
+    avr_core_init(scratch, history->scratch);
+    scratch->uart_tx_drain = core->uart_tx_fd >= 0;
+}
+
+// instructions at which the replay from checkpoint index has to stop
+static uint64_t
+segment_end(avr_core *core, size_t index)
+{
+    avr_history *history = core->history;
+    return index + 1 < history->count ? history->checkpoints[index + 1]->instructions : core->state->instructions;
+}
+
+// raw value at a data address, reading through the io space would have side effects
+static uint8_t
+peek(const avr_state *state, uint16_t address)
+{
+    if (address < IO_START)
+        return state->registers[address];
+    if (address < SRAM_START)
+        return state->io_registers[address - IO_START];
+    return state->sram[address - SRAM_START];
+}
+
+// go back to the state after the given number of instructions, returns -1 with errno set
+int
+avr_history_seek(avr_core *core, uint64_t instructions)
+{
+    avr_history *history = core->history;
+    avr_core scratch;
+
+    if (check_history(history) < 0)
+        return -1;
+    if (history->count == 0 || instructions > core->state->instructions
+            || instructions < history->checkpoints[0]->instructions) {
+        errno = ERANGE;
+        return -1;
+    }
+
+    size_t index = history->count - 1;
+    while (history->checkpoints[index]->instructions > instructions)
+        index--;
+
+    load_scratch(core, index, &scratch);
+    while (scratch.state->instructions < instructions)
+        avr_run_instruction(&scratch);
+    memcpy(core->state, history->scratch, sizeof(avr_state));
+
+    // streamed uart output was delivered already and must not be sent twice
+    if (core->uart_tx_fd >= 0)
+        core->state->uart.tx.tail = core->state->uart.tx.head;
+
+    truncate_history(history, index + 1);
+    history->next_checkpoint = history->checkpoints[index]->cycles + history->interval;
+    return 0;
+}
+
+// go back to the last instruction boundary at or before cycle
+int
+avr_history_back_to_cycle(avr_core *core, uint64_t cycle)
+{
+    avr_history *history = core->history;
+    avr_core scratch;
+
+    if (check_history(history) < 0)
+        return -1;
+    if (history->count == 0 || cycle >= core->state->cycles || cycle < history->checkpoints[0]->cycles) {
+        errno = ERANGE;
+        return -1;
+    }
+
+    size_t index = history->count - 1;
+    while (history->checkpoints[index]->cycles > cycle)
+        index--;
+
+    load_scratch(core, index, &scratch);
+    uint64_t target = scratch.state->instructions;
+    while (scratch.state->instructions < core->state->instructions) {
+        avr_run_instruction(&scratch);
+        if (scratch.state->cycles > cycle)
+            break;
+        target = scratch.state->instructions;
+    }
+    return avr_history_seek(core, target);
+}
+
+// go back to the last time the program counter was at program_counter, returns 1 if found,
+// 0 if the history holds no such point and -1 with errno set
+int
+avr_history_back_to_pc(avr_core *core, uint16_t program_counter)
+{
+    avr_history *history = core->history;
+    avr_core scratch;
+
+    if (check_history(history) < 0)
+        return -1;
+
+    for (size_t index = history->count; index-- > 0;) {
+        uint64_t end = segment_end(core, index);
+        uint64_t target = 0;
+        int found = 0;
+
+        load_scratch(core, index, &scratch);
+        while (scratch.state->instructions < end) {
+            if (scratch.state->program_counter == program_counter) {
+                target = scratch.state->instructions;
+                found = 1;
+            }
+            avr_run_instruction(&scratch);
+        }
+        if (found)
+            return avr_history_seek(core, target) < 0 ? -1 : 1;
+    }
+    return 0;
+}
+
+// find the last instruction that wrote to a data address, stores of an unchanged value count
+// when they go through the data space. Returns 1 if found, 0 if not and -1 with errno set.
+int
+avr_history_last_write(avr_core *core, uint16_t address, avr_history_write *write)
+{
+    avr_history *history = core->history;
+    avr_core scratch;
+
+    if (check_history(history) < 0)
+        return -1;
+    if (address >= DATA_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t index = history->count; index-- > 0;) {
+        uint64_t end = segment_end(core, index);
+        int found = 0;
+
+        load_scratch(core, index, &scratch);
+        scratch.watch_address = address;
+        while (scratch.state->instructions < end) {
+            avr_history_write before = {
+                scratch.state->instructions, scratch.state->cycles, scratch.state->program_counter
+            };
+            uint8_t value = peek(scratch.state, address);
+
+            scratch.watch_hit = 0;
+            avr_run_instruction(&scratch);
+            if (scratch.watch_hit || peek(scratch.state, address) != value) {
+                *write = before;
+                found = 1;
+            }
+        }
+        if (found)
+            return 1;
+    }
+    return 0;
+}
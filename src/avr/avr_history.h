@@ -0,0 +1,46 @@
+#ifndef AVR_HISTORY
+#define AVR_HISTORY
+
+#include "avr_core.h"
+
+/* Reverse execution. Checkpoints of the whole state are taken every interval cycles and
+   whenever the host changes the state, so the stretch between two checkpoints is a pure
+   function of the first one. Going back restores the nearest checkpoint and replays forward
+   on a scratch state. */
+
+struct avr_history {
+    avr_state   **checkpoints;  /* oldest first, ordered by instructions */
+    size_t      count;
+    size_t      capacity;
+    size_t      limit;          /* the oldest checkpoint is recycled beyond this, 0 for no limit */
+    uint64_t    interval;       /* cycles between periodic checkpoints */
+    uint64_t    next_checkpoint;
+    avr_state   *scratch;       /* replay target of the queries */
+    int         failed;         /* checkpointing stopped on an allocation failure */
+};
+
+typedef struct {
+    uint64_t    instructions;   /* instructions retired before the writing instruction */
+    uint64_t    cycles;
+    uint16_t    program_counter;
+} avr_history_write;
+
+int avr_history_start(avr_core *core, avr_history *history, uint64_t interval, size_t limit);
+void avr_history_stop(avr_core *core);
+void avr_history_checkpoint(avr_core *core);
+void avr_history_mark(avr_core *core);
+
+int avr_history_seek(avr_core *core, uint64_t instructions);
+int avr_history_back_to_cycle(avr_core *core, uint64_t cycle);
+int avr_history_back_to_pc(avr_core *core, uint16_t program_counter);
+int avr_history_last_write(avr_core *core, uint16_t address, avr_history_write *write);
+
+// called after every instruction, a single test while no history is kept
+static inline void
+avr_history_tick(avr_core *core)
+{
+    if (core->history != NULL && core->state->cycles >= core->history->next_checkpoint)
+        avr_history_checkpoint(core);
+}
+
+#endif
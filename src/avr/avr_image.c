@@ -0,0 +1,144 @@
+#include "avr_core.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+static int
+hex_value(const char *text, int digits)
+{
+    int value = 0;
+    for (int i = 0; i < digits; i++) {
+        char c = text[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return value;
+}
+
+// put one byte at a flash byte address, flash words are little endian
+static int
+store_byte(avr_state *state, uint32_t address, uint8_t value)
+{
+    if (address >= 2 * PROGRAM_MEMORY_SIZE) {
+        errno = EFBIG;
+        return -1;
+    }
+    uint16_t *word = &state->program_memory[address / 2];
+    if (address % 2)
+        *word = (*word & 0x00FF) | (value << 8);
+    else
+        *word = (*word & 0xFF00) | value;
+    return 0;
+}
+
+// Intel HEX as written by avr-objcopy, data and end of file records plus segment/linear bases
+static int
+load_ihex(avr_state *state, FILE *file)
+{
+    char line[600];
+    uint32_t base = 0, end = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '\r' || line[0] == '\n')
+            continue;
+        if (line[0] != ':')
+            goto format_error;
+
+        int count = hex_value(&line[1], 2);
+        int offset = hex_value(&line[3], 4);
+        int type = hex_value(&line[7], 2);
+        if (count < 0 || offset < 0 || type < 0 || strlen(line) < (size_t)(11 + 2 * count))
+            goto format_error;
+
+        uint8_t data[255];
+        uint8_t checksum = count + (offset >> 8) + offset + type;
+        for (int i = 0; i <= count; i++) {
+            int value = hex_value(&line[9 + 2 * i], 2);
+            if (value < 0)
+                goto format_error;
+            if (i < count)
+                data[i] = value;
+            checksum += value;
+        }
+        if (checksum != 0)
+            goto format_error;
+
+        switch (type) {
+        case 0x00:
+            for (int i = 0; i < count; i++) {
+                if (store_byte(state, base + offset + i, data[i]) < 0)
+                    return -1;
+            }
+            if (base + offset + count > end)
+                end = base + offset + count;
+            break;
+        case 0x01:
+            return (int)((end + 1) / 2);
+        case 0x02:
+            if (count != 2)
+                goto format_error;
+            base = ((data[0] << 8) | data[1]) << 4;
+            break;
+        case 0x04:
+            if (count != 2)
+                goto format_error;
+            base = (uint32_t)((data[0] << 8) | data[1]) << 16;
+            break;
+        default:
+            // start address records carry nothing for the flash
+            break;
+        }
+    }
+    if (ferror(file))
+        return -1;
+    return (int)((end + 1) / 2);
+
+format_error:
+    errno = EINVAL;
+    return -1;
+}
+
+// raw flash dump, little endian words from address zero
+static int
+load_binary(avr_state *state, FILE *file)
+{
+    uint8_t data[2 * PROGRAM_MEMORY_SIZE + 1];
+    size_t length = fread(data, 1, sizeof(data), file);
+
+    if (ferror(file))
+        return -1;
+    if (length > 2 * PROGRAM_MEMORY_SIZE) {
+        errno = EFBIG;
+        return -1;
+    }
+    for (size_t i = 0; i < length; i++)
+        store_byte(state, (uint32_t)i, data[i]);
+    return (int)((length + 1) / 2);
+}
+
+// load an Intel HEX file or a raw binary into the flash, returns the number of words
+// spanned by the image, or -1 with errno set
+int
+avr_load_image(avr_state *state, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return -1;
+
+    int first = fgetc(file);
+    rewind(file);
+
+    int words = first == ':' ? load_ihex(state, file) : load_binary(state, file);
+
+    int saved_errno = errno;
+    fclose(file);
+    errno = saved_errno;
+    return words;
+}
@@ -0,0 +1,194 @@
+/* Benchmark kernels, generated programs per instruction class plus small firmware images */
+
+#include "avr_kernels.h"
+#include "avr_uart.h"
+
+#include <stdlib.h>
+
+// SREG flag the loop kernels branch on, none of their bodies ever sets T
+#define LOOP_FLAG (6)
+
+#define two_register(opcode, d, r) ((opcode) | (((r) & 0x10) << 5) | ((d) << 4) | ((r) & 0x0F))
+#define immediate(opcode, d, k) ((opcode) | (((k) & 0xF0) << 4) | (((d) - 16) << 4) | ((k) & 0x0F))
+#define one_register(opcode, d) ((opcode) | ((d) << 4))
+#define branch(opcode, flag, k) ((opcode) | (((k) & 0x7F) << 3) | (flag))
+#define io(opcode, a, r) ((opcode) | (((a) & 0x30) << 5) | ((r) << 4) | ((a) & 0x0F))
+
+#define ADD(d, r)   two_register(0b0000110000000000, d, r)
+#define ADC(d, r)   two_register(0b0001110000000000, d, r)
+#define AND(d, r)   two_register(0b0010000000000000, d, r)
+#define EOR(d, r)   two_register(0b0010010000000000, d, r)
+#define OR(d, r)    two_register(0b0010100000000000, d, r)
+#define MOV(d, r)   two_register(0b0010110000000000, d, r)
+#define CP(d, r)    two_register(0b0001010000000000, d, r)
+#define CPC(d, r)   two_register(0b0000010000000000, d, r)
+#define CPSE(d, r)  two_register(0b0001000000000000, d, r)
+#define ANDI(d, k)  immediate(0b0111000000000000, d, k)
+#define CPI(d, k)   immediate(0b0011000000000000, d, k)
+#define LDI(d, k)   immediate(0b1110000000000000, d, k)
+#define COM(d)      one_register(0b1001010000000000, d)
+#define NEG(d)      one_register(0b1001010000000001, d)
+#define INC(d)      one_register(0b1001010000000011, d)
+#define LSR(d)      one_register(0b1001010000000110, d)
+#define DEC(d)      one_register(0b1001010000001010, d)
+#define LAC(d)      one_register(0b1001001000000100, d)
+#define LAS(d)      one_register(0b1001001000000101, d)
+#define LAT(d)      one_register(0b1001001000000111, d)
+#define BSET(s)     (0b1001010000001000 | ((s) << 4))
+#define BCLR(s)     (0b1001010010001000 | ((s) << 4))
+#define BST(d, b)   (0b1111101000000000 | ((d) << 4) | (b))
+#define BLD(d, b)   (0b1111100000000000 | ((d) << 4) | (b))
+#define CBI(a, b)   (0b1001100000000000 | ((a) << 3) | (b))
+#define BRBS(s, k)  branch(0b1111000000000000, s, k)
+#define BRBC(s, k)  branch(0b1111010000000000, s, k)
+#define IN(d, a)    io(0b1011000000000000, a, d)
+#define OUT(a, r)   io(0b1011100000000000, a, r)
+#define NOP         (0)
+
+static const uint16_t alu_body[] = {
+    ADD(1, 2), ADC(3, 4), AND(5, 6), EOR(7, 8), OR(9, 10), CP(11, 12), CPC(13, 14), COM(15),
+    INC(16), DEC(17), ANDI(18, 0x5A), CPI(19, 0x33), LSR(20), NEG(22), MOV(23, 24), ADD(25, 1),
+};
+
+static const uint16_t branch_body[] = {
+    BRBS(LOOP_FLAG, 0), BRBC(LOOP_FLAG, 0), BRBS(7, 0), BRBC(7, 0),
+    CPSE(0, 1), NOP, BRBS(1, 0), BRBC(1, 0),
+};
+
+static const uint16_t load_store_body[] = {
+    LDI(16, 0x55), MOV(1, 16), IN(2, 0x3D), OUT(0x3E, 2), IN(3, 0x3E), OUT(0x3D, 3),
+    LAC(4), LAS(5), LAT(6), MOV(7, 1), LDI(17, 0xAA), OUT(0x12, 17),
+};
+
+static const uint16_t bit_body[] = {
+    BSET(0), BCLR(0), BSET(3), BCLR(3), BST(1, 3), BLD(2, 4), CBI(0x10, 2), BSET(1),
+    BCLR(1), BLD(3, 7),
+};
+
+// fill the whole flash with the body, the program counter wraps so there is no branch
+static int
+straight(uint16_t *flash, const uint16_t *body, int length)
+{
+    for (int i = 0; i < PROGRAM_MEMORY_SIZE; i++)
+        flash[i] = body[i % length];
+    return PROGRAM_MEMORY_SIZE;
+}
+
+// the body followed by an always taken branch back to the start
+static int
+loop(uint16_t *flash, const uint16_t *body, int length)
+{
+    memcpy(flash, body, length * sizeof(uint16_t));
+    flash[length] = BRBC(LOOP_FLAG, -(length + 1));
+    return length + 1;
+}
+
+#define LENGTH(body) ((int)(sizeof(body) / sizeof(body[0])))
+
+static int alu_straight(uint16_t *flash) { return straight(flash, alu_body, LENGTH(alu_body)); }
+static int alu_loop(uint16_t *flash) { return loop(flash, alu_body, LENGTH(alu_body)); }
+static int branch_straight(uint16_t *flash) { return straight(flash, branch_body, LENGTH(branch_body)); }
+static int branch_loop(uint16_t *flash) { return loop(flash, branch_body, LENGTH(branch_body)); }
+static int load_store_straight(uint16_t *flash) { return straight(flash, load_store_body, LENGTH(load_store_body)); }
+static int load_store_loop(uint16_t *flash) { return loop(flash, load_store_body, LENGTH(load_store_body)); }
+static int bit_straight(uint16_t *flash) { return straight(flash, bit_body, LENGTH(bit_body)); }
+static int bit_loop(uint16_t *flash) { return loop(flash, bit_body, LENGTH(bit_body)); }
+
+// logger main loop: poll UDRE, send a byte, next byte
+static int
+firmware_uart_log(uint16_t *flash)
+{
+    static const uint16_t image[] = {
+        LDI(16, 1 << TXEN), OUT(UCSRB, 16), LDI(16, 'A'),
+        IN(17, UCSRA), ANDI(17, 1 << UDRE), BRBS(1, -3),
+        OUT(UDR, 16), INC(16), BRBC(LOOP_FLAG, -6),
+    };
+    memcpy(flash, image, sizeof(image));
+    return LENGTH(image);
+}
+
+// busy wait delay loop around a port toggle
+static int
+firmware_delay(uint16_t *flash)
+{
+    static const uint16_t image[] = {
+        LDI(18, 0x01), IN(19, 0x18), EOR(19, 18), OUT(0x18, 19),
+        LDI(16, 200), DEC(16), BRBC(1, -2), BRBC(LOOP_FLAG, -8),
+    };
+    memcpy(flash, image, sizeof(image));
+    return LENGTH(image);
+}
+
+// 16 bit additive checksum with a mixing step
+static int
+firmware_checksum(uint16_t *flash)
+{
+    static const uint16_t image[] = {
+        LDI(16, 0x21), LDI(17, 0x00), MOV(2, 16),
+        ADD(24, 2), ADC(25, 17), EOR(24, 25), LSR(25), INC(2), MOV(3, 2),
+        AND(3, 16), CPI(16, 0x40), CP(24, 25), CPC(25, 24), BRBC(LOOP_FLAG, -11),
+    };
+    memcpy(flash, image, sizeof(image));
+    return LENGTH(image);
+}
+
+const avr_bench_kernel avr_bench_kernels[] = {
+    {"alu_straight",        "alu",          alu_straight},
+    {"alu_loop",            "alu",          alu_loop},
+    {"branch_straight",     "branch",       branch_straight},
+    {"branch_loop",         "branch",       branch_loop},
+    {"load_store_straight", "load_store",   load_store_straight},
+    {"load_store_loop",     "load_store",   load_store_loop},
+    {"bit_straight",        "bit",          bit_straight},
+    {"bit_loop",            "bit",          bit_loop},
+    {"uart_log",            "firmware",     firmware_uart_log},
+    {"delay",               "firmware",     firmware_delay},
+    {"checksum",            "firmware",     firmware_checksum},
+    {NULL,                  NULL,           NULL}           /* sentinel */
+};
+
+const avr_bench_kernel *
+avr_bench_find(const char *name)
+{
+    for (const avr_bench_kernel *kernel = avr_bench_kernels; kernel->name != NULL; kernel++) {
+        if (strcmp(kernel->name, name) == 0)
+            return kernel;
+    }
+    return NULL;
+}
+
+// best of repeats runs of the kernel, returns -1 if the state can't be allocated
+int
+avr_bench_run(const avr_bench_kernel *kernel, uint64_t instructions, int repeats, avr_bench_result *result)
+{
+    avr_state *state = malloc(sizeof(avr_state));
+    avr_core core;
+    if (state == NULL)
+        return -1;
+
+    memset(result, 0, sizeof(*result));
+    result->kernel = kernel;
+
+    for (int repeat = 0; repeat < repeats || repeat == 0; repeat++) {
+        avr_core_init(&core, state);
+        avr_state_reset(state);
+        kernel->build(state->program_memory);
+
+        uint64_t start = avr_monotonic_ns();
+        uint64_t executed = avr_run(&core, AVR_UNLIMITED, instructions);
+        uint64_t elapsed = avr_monotonic_ns() - start;
+
+        if (repeat == 0 || elapsed < result->elapsed_ns) {
+            result->instructions = executed;
+            result->cycles = state->cycles;
+            result->elapsed_ns = elapsed ? elapsed : 1;
+        }
+    }
+    free(state);
+
+    double seconds = result->elapsed_ns / 1e9;
+    result->mips = result->instructions / seconds / 1e6;
+    result->ns_per_instruction = result->instructions ? (double)result->elapsed_ns / result->instructions : 0;
+    result->cycles_per_second = result->cycles / seconds;
+    return 0;
+}
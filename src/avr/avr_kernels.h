@@ -0,0 +1,28 @@
+#ifndef AVR_KERNELS
+#define AVR_KERNELS
+
+#include "avr_core.h"
+
+typedef struct {
+    const char  *name;
+    const char  *instruction_class;
+    int         (*build)(uint16_t *flash);  /* writes the program, returns its length in words */
+} avr_bench_kernel;
+
+typedef struct {
+    const avr_bench_kernel *kernel;
+    uint64_t    instructions;
+    uint64_t    cycles;
+    uint64_t    elapsed_ns;
+    double      mips;
+    double      ns_per_instruction;
+    double      cycles_per_second;
+} avr_bench_result;
+
+// terminated by an entry with a NULL name
+extern const avr_bench_kernel avr_bench_kernels[];
+
+const avr_bench_kernel *avr_bench_find(const char *name);
+int avr_bench_run(const avr_bench_kernel *kernel, uint64_t instructions, int repeats, avr_bench_result *result);
+
+#endif
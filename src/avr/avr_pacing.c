@@ -0,0 +1,93 @@
+#include "avr_core.h"
+#include "avr_uart.h"
+
+#include <errno.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+uint64_t
+avr_monotonic_ns(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// sleep up to spin_ns before the deadline, then busy wait for the rest
+void
+avr_sleep_until(uint64_t deadline, uint64_t spin_ns)
+{
+    uint64_t now = avr_monotonic_ns();
+
+    if (deadline > now + spin_ns) {
+        uint64_t wake = deadline - spin_ns;
+#if defined(__linux__)
+        struct timespec ts = {(time_t)(wake / 1000000000u), (long)(wake % 1000000000u)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+#elif defined(_WIN32)
+        Sleep((DWORD)((wake - now) / 1000000u));
+#else
+        uint64_t delta = wake - now;
+        struct timespec ts = {(time_t)(delta / 1000000000u), (long)(delta % 1000000000u)};
+        nanosleep(&ts, NULL);
+#endif
+    }
+
+    while (avr_monotonic_ns() < deadline)
+        ;
+}
+
+// run cycles locked to the wall clock at frequency, returns -1 and sets errno if the uart flush fails
+int
+avr_run_paced(avr_core *core, uint64_t cycles, double frequency, uint64_t batch_cycles,
+              uint64_t spin_ns, avr_pacing_stats *stats)
+{
+    avr_state *state = core->state;
+    uint64_t start_cycle = state->cycles;
+    uint64_t executed = 0;
+
+    memset(stats, 0, sizeof(*stats));
+
+    // one millisecond of emulated time per batch unless asked otherwise
+    if (batch_cycles == 0)
+        batch_cycles = frequency >= 1000 ? (uint64_t)(frequency / 1000) : 1;
+
+    uint64_t start = avr_monotonic_ns();
+    while (executed < cycles && !state->break_point_reached) {
+        uint64_t batch_end = start_cycle + (cycles - executed < batch_cycles ? cycles : executed + batch_cycles);
+        // the free run engine, it stops at BREAK and at the end of the batch
+        avr_run(core, batch_end - state->cycles, AVR_UNLIMITED);
+        executed = state->cycles - start_cycle;
+        stats->batches += 1;
+
+        // deadlines are absolute, so a late batch is caught up by the next ones
+        uint64_t deadline = start + (uint64_t)((double)executed * 1e9 / frequency);
+        uint64_t now = avr_monotonic_ns();
+        if (now > deadline) {
+            stats->overruns += 1;
+            if (now - deadline > stats->max_overrun_ns)
+                stats->max_overrun_ns = now - deadline;
+            continue;
+        }
+
+        avr_sleep_until(deadline, spin_ns);
+        uint64_t jitter = avr_monotonic_ns() - deadline;
+        stats->total_jitter_ns += jitter;
+        if (jitter > stats->max_jitter_ns)
+            stats->max_jitter_ns = jitter;
+    }
+    stats->elapsed_ns = avr_monotonic_ns() - start;
+    stats->cycles = executed;
+
+    return avr_uart_flush(core);
+}
@@ -0,0 +1,249 @@
+/* Record/replay of host inputs, see avr_replay.h for the log format */
+
+#include "avr_replay.h"
+#include "avr_uart.h"
+#include "avr_history.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#define LOG_INITIAL_CAPACITY (256)
+
+// longest varint of a uint64_t
+#define VARINT_MAX (10)
+
+static int
+reserve(avr_log *log, size_t extra)
+{
+    if (log->failed)
+        return -1;
+    if (log->length + extra <= log->capacity)
+        return 0;
+
+    size_t capacity = log->capacity ? log->capacity : LOG_INITIAL_CAPACITY;
+    while (capacity < log->length + extra)
+        capacity *= 2;
+    uint8_t *data = realloc(log->data, capacity);
+    if (data == NULL) {
+        log->failed = 1;
+        return -1;
+    }
+    log->data = data;
+    log->capacity = capacity;
+    return 0;
+}
+
+static void
+put_varint(avr_log *log, uint64_t value)
+{
+    while (value >= 0x80) {
+        log->data[log->length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    log->data[log->length++] = (uint8_t)value;
+}
+
+static int
+get_varint(const uint8_t **position, const uint8_t *end, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 7 * VARINT_MAX; shift += 7) {
+        if (*position == end)
+            return -1;
+        uint8_t byte = *(*position)++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+// append the record header, the caller reserved room for it and for the payload
+static void
+put_event(avr_log *log, uint64_t cycle, int kind)
+{
+    put_varint(log, ((cycle - log->cycle) << 3) | kind);
+    log->cycle = cycle;
+}
+
+// start an empty log at the given cycle, returns -1 with errno set
+int
+avr_log_start(avr_log *log, uint64_t cycle)
+{
+    memset(log, 0, sizeof(*log));
+    if (reserve(log, VARINT_MAX) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    put_varint(log, cycle);
+    log->cycle = cycle;
+    return 0;
+}
+
+void
+avr_log_stop(avr_log *log, uint64_t cycle)
+{
+    if (reserve(log, VARINT_MAX) == 0)
+        put_event(log, cycle, AVR_EVENT_END);
+}
+
+void
+avr_log_free(avr_log *log)
+{
+    free(log->data);
+    memset(log, 0, sizeof(*log));
+}
+
+/* Applying inputs */
+
+static void
+apply_io_register(avr_state *state, uint8_t address, uint8_t value)
+{
+    // raw store without side effects, let the peripherals re-evaluate
+    state->io_registers[address % IO_REGISTER_SIZE] = value;
+    state->uart.next_event = 0;
+    state->spi.next_event = 0;
+}
+
+// returns the number of bytes the receiver accepted
+uint32_t
+avr_input_uart(avr_core *core, const uint8_t *data, uint32_t length)
+{
+    avr_log *log = core->record;
+    uint32_t accepted = avr_uart_rx_push(core->state, data, length);
+
+    avr_history_mark(core);
+    if (log != NULL && accepted > 0 && reserve(log, 2 * VARINT_MAX + accepted) == 0) {
+        put_event(log, core->state->cycles, AVR_EVENT_UART_RX);
+        put_varint(log, accepted);
+        memcpy(&log->data[log->length], data, accepted);
+        log->length += accepted;
+    }
+    return accepted;
+}
+
+void
+avr_input_io_register(avr_core *core, uint8_t address, uint8_t value)
+{
+    avr_log *log = core->record;
+
+    apply_io_register(core->state, address, value);
+    avr_history_mark(core);
+    if (log != NULL && reserve(log, VARINT_MAX + 2) == 0) {
+        put_event(log, core->state->cycles, AVR_EVENT_IO_REGISTER);
+        log->data[log->length++] = address;
+        log->data[log->length++] = value;
+    }
+}
+
+void
+avr_input_register(avr_core *core, uint8_t index, uint8_t value)
+{
+    avr_log *log = core->record;
+
+    core->state->registers[index % REGISTER_SIZE] = value;
+    avr_history_mark(core);
+    if (log != NULL && reserve(log, VARINT_MAX + 2) == 0) {
+        put_event(log, core->state->cycles, AVR_EVENT_REGISTER);
+        log->data[log->length++] = index;
+        log->data[log->length++] = value;
+    }
+}
+
+void
+avr_input_sreg(avr_core *core, uint8_t value)
+{
+    avr_log *log = core->record;
+
+    core->state->sreg = value;
+    avr_history_mark(core);
+    if (log != NULL && reserve(log, VARINT_MAX + 1) == 0) {
+        put_event(log, core->state->cycles, AVR_EVENT_SREG);
+        log->data[log->length++] = value;
+    }
+}
+
+/* Replay */
+
+// run up to the cycle of the next input, a recorded input always landed on an instruction
+// boundary, so the run has to stop exactly there
+static int
+run_to(avr_core *core, uint64_t cycle)
+{
+    avr_state *state = core->state;
+    if (cycle > state->cycles)
+        avr_run(core, cycle - state->cycles, AVR_UNLIMITED);
+    return state->cycles == cycle ? 0 : -1;
+}
+
+// feed a recorded log to a state equal to the one recording started from, up to the end of the
+// recording or max_cycles from now, whichever comes first. Returns -1 with errno EINVAL if the
+// log is malformed or the run diverges from it, the state is then left where it diverged.
+int
+avr_replay(avr_core *core, const uint8_t *log, size_t length, uint64_t max_cycles)
+{
+    avr_state *state = core->state;
+    const uint8_t *position = log, *end = log + length;
+    uint64_t cycle, stop = state->cycles + max_cycles;
+
+    if (stop < state->cycles)
+        stop = AVR_UNLIMITED;
+    if (get_varint(&position, end, &cycle) < 0 || cycle != state->cycles)
+        goto invalid;
+
+    while (position < end) {
+        uint64_t header, count;
+        int kind;
+
+        if (get_varint(&position, end, &header) < 0)
+            goto invalid;
+        cycle += header >> 3;
+        kind = header & 0b111;
+
+        if (cycle > stop) {
+            avr_run(core, stop - state->cycles, AVR_UNLIMITED);
+            return 0;
+        }
+        if (run_to(core, cycle) < 0)
+            goto invalid;
+
+        switch (kind) {
+        case AVR_EVENT_UART_RX:
+            if (get_varint(&position, end, &count) < 0 || count > (uint64_t)(end - position))
+                goto invalid;
+            if (avr_uart_rx_push(state, position, (uint32_t)count) != count)
+                goto invalid;
+            position += count;
+            break;
+        case AVR_EVENT_IO_REGISTER:
+            if (end - position < 2)
+                goto invalid;
+            apply_io_register(state, position[0], position[1]);
+            position += 2;
+            break;
+        case AVR_EVENT_REGISTER:
+            if (end - position < 2)
+                goto invalid;
+            state->registers[position[0] % REGISTER_SIZE] = position[1];
+            position += 2;
+            break;
+        case AVR_EVENT_SREG:
+            if (end - position < 1)
+                goto invalid;
+            state->sreg = *position++;
+            break;
+        case AVR_EVENT_END:
+            return 0;
+        default:
+            goto invalid;
+        }
+        avr_history_mark(core);
+    }
+    // a log without an end record, run the rest of the budget
+    avr_run(core, stop - state->cycles, AVR_UNLIMITED);
+    return 0;
+
+invalid:
+    errno = EINVAL;
+    return -1;
+}
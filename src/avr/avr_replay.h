@@ -0,0 +1,38 @@
+#ifndef AVR_REPLAY
+#define AVR_REPLAY
+
+#include "avr_core.h"
+
+/* Record/replay of host inputs.
+
+   A log starts with the cycle count at which recording began, followed by one record per
+   input: varint((cycle delta << 3) | kind) and the payload of the kind. Varints are
+   little endian base 128. */
+
+#define AVR_EVENT_UART_RX       (0)     /* varint length, bytes */
+#define AVR_EVENT_IO_REGISTER   (1)     /* address, value, raw store */
+#define AVR_EVENT_REGISTER      (2)     /* index, value */
+#define AVR_EVENT_SREG          (3)     /* value */
+#define AVR_EVENT_END           (4)     /* recording stopped, nothing follows */
+
+struct avr_log {
+    uint8_t     *data;
+    size_t      length;
+    size_t      capacity;
+    uint64_t    cycle;          /* cycle of the last record */
+    int         failed;         /* a record was lost to an allocation failure */
+};
+
+int avr_log_start(avr_log *log, uint64_t cycle);
+void avr_log_stop(avr_log *log, uint64_t cycle);
+void avr_log_free(avr_log *log);
+
+// host inputs, applied to the state and appended to core->record when it is set
+uint32_t avr_input_uart(avr_core *core, const uint8_t *data, uint32_t length);
+void avr_input_io_register(avr_core *core, uint8_t address, uint8_t value);
+void avr_input_register(avr_core *core, uint8_t index, uint8_t value);
+void avr_input_sreg(avr_core *core, uint8_t value);
+
+int avr_replay(avr_core *core, const uint8_t *log, size_t length, uint64_t max_cycles);
+
+#endif
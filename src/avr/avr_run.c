@@ -0,0 +1,219 @@
+/* avr-run, executes a firmware image on the emulator core without Python */
+
+#include "avr_core.h"
+#include "avr_uart.h"
+#include "avr_storage.h"
+#include "avr_validate.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/shm.h>
+
+static void
+usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-c cycles] [-n instructions] [-i input] [-e eeprom] [-x] [-u] [-t] [-V] image\n"
+            "  -c cycles        stop after this many cycles\n"
+            "  -n instructions  stop after this many instructions\n"
+            "  -i input         feed this file to the UART receiver, - for stdin\n"
+            "  -e eeprom        keep the EEPROM in this file, it is created if missing\n"
+            "  -x               discard EEPROM writes instead of saving them to the file\n"
+            "  -u               stream UART output to stdout\n"
+            "  -t               print timing to stderr\n"
+            "  -V               check the fast engine against the reference interpreter instead,\n"
+            "                   exits with 3 and prints the first divergence to stderr\n"
+            "Runs up to the BREAK instruction unless a budget runs out first.\n"
+            "The image is Intel HEX or a raw little endian flash dump.\n"
+            "Edge coverage goes to the AFL shared memory map when __AFL_SHM_ID is set.\n",
+            name);
+}
+
+static int
+parse_count(const char *text, uint64_t *value)
+{
+    char *end;
+    errno = 0;
+    *value = strtoull(text, &end, 0);
+    return errno != 0 || end == text || *end != '\0' ? -1 : 0;
+}
+
+// queue the input file for the uart receiver, whatever does not fit into the ring is dropped
+static int
+feed_input(avr_state *state, const char *path)
+{
+    uint8_t data[UART_BUFFER_SIZE];
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == NULL)
+        return -1;
+
+    size_t length = fread(data, 1, sizeof(data), file);
+    int failed = ferror(file);
+    if (file != stdin)
+        fclose(file);
+    if (failed) {
+        errno = EIO;
+        return -1;
+    }
+    avr_uart_rx_push(state, data, (uint32_t)length);
+    return 0;
+}
+
+// attach the afl-fuzz coverage map, NULL when not running under afl
+static uint8_t *
+afl_coverage_map(void)
+{
+    const char *id = getenv("__AFL_SHM_ID");
+    if (id == NULL)
+        return NULL;
+
+    void *map = shmat(atoi(id), NULL, 0);
+    if (map == (void *)-1) {
+        perror("__AFL_SHM_ID");
+        exit(1);
+    }
+    return map;
+}
+
+// lockstep the fast engine with the reference, 0 when they agree all the way and 3 when not
+static int
+run_validation(const avr_state *state, uint64_t max_instructions)
+{
+    static avr_state reference, result;
+    avr_state_diff diffs[16];
+    avr_divergence divergence;
+
+    int rv = avr_validate(state, avr_run_backend, NULL, max_instructions, 1024, &reference, &result, &divergence);
+    if (rv < 0) {
+        perror("validate");
+        return 1;
+    }
+    if (rv == 0) {
+        fprintf(stderr, "validated %llu instructions\n", (unsigned long long)reference.instructions);
+        return 0;
+    }
+
+    size_t count = avr_state_diff_list(&reference, &result, diffs, 16);
+    fprintf(stderr, "divergence after %llu instructions at pc 0x%04x, instruction 0x%04x\n",
+            (unsigned long long)divergence.instructions, divergence.program_counter, divergence.instruction);
+    for (size_t i = 0; i < count && i < 16; i++) {
+        if (diffs[i].index < 0)
+            fprintf(stderr, "  %s", diffs[i].field);
+        else
+            fprintf(stderr, "  %s[%d]", diffs[i].field, diffs[i].index);
+        fprintf(stderr, ": reference 0x%llx, fast 0x%llx\n",
+                (unsigned long long)diffs[i].reference, (unsigned long long)diffs[i].backend);
+    }
+    if (count > 16)
+        fprintf(stderr, "  ... %zu more\n", count - 16);
+    return 3;
+}
+
+int
+main(int argc, char **argv)
+{
+    uint64_t max_cycles = AVR_UNLIMITED;
+    uint64_t max_instructions = AVR_UNLIMITED;
+    int stream_uart = 0;
+    int timing = 0;
+    int validate = 0;
+    const char *input = NULL;
+    const char *eeprom = NULL;
+    int eeprom_mode = AVR_MAP_WRITE;
+    int option;
+
+    while ((option = getopt(argc, argv, "c:n:i:e:xutVh")) != -1) {
+        switch (option) {
+        case 'c':
+            if (parse_count(optarg, &max_cycles) < 0) {
+                fprintf(stderr, "invalid cycle count: %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'n':
+            if (parse_count(optarg, &max_instructions) < 0) {
+                fprintf(stderr, "invalid instruction count: %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'i':
+            input = optarg;
+            break;
+        case 'e':
+            eeprom = optarg;
+            break;
+        case 'x':
+            eeprom_mode = AVR_MAP_COPY;
+            break;
+        case 'u':
+            stream_uart = 1;
+            break;
+        case 't':
+            timing = 1;
+            break;
+        case 'V':
+            validate = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    static avr_state state;
+    avr_core core;
+    avr_core_init(&core, &state);
+    avr_state_reset(&state);
+
+    int words = avr_load_image(&state, argv[optind]);
+    if (words < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (input != NULL && feed_input(&state, input) < 0) {
+        perror(input);
+        return 1;
+    }
+    if (eeprom != NULL && avr_attach_eeprom(&core, eeprom, eeprom_mode) < 0) {
+        perror(eeprom);
+        return 1;
+    }
+    core.coverage_map = afl_coverage_map();
+    if (stream_uart) {
+        fflush(stdout);
+        core.uart_tx_fd = 1;
+    }
+
+    if (validate)
+        return run_validation(&state, max_instructions);
+
+    uint64_t start = avr_monotonic_ns();
+    uint64_t executed = avr_run(&core, max_cycles, max_instructions);
+    uint64_t elapsed = avr_monotonic_ns() - start;
+
+    if (avr_uart_flush(&core) < 0) {
+        perror("uart");
+        return 1;
+    }
+
+    if (timing) {
+        double seconds = elapsed / 1e9;
+        fprintf(stderr, "image: %d words\n", words);
+        fprintf(stderr, "stopped: %s\n", state.break_point_reached ? "break" : "budget");
+        fprintf(stderr, "cycles: %llu\n", (unsigned long long)state.cycles);
+        fprintf(stderr, "instructions: %llu\n", (unsigned long long)executed);
+        fprintf(stderr, "time: %.6f s\n", seconds);
+        if (executed && elapsed) {
+            fprintf(stderr, "MIPS: %.2f\n", executed / seconds / 1e6);
+            fprintf(stderr, "ns/instruction: %.2f\n", (double)elapsed / executed);
+            fprintf(stderr, "cycles/s: %.0f\n", state.cycles / seconds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+/* SPI, bytes are shifted through the spi rings, the other end is whatever links them */
+
+#include "avr_spi.h"
+
+// cycles needed to shift one byte at the configured clock divider
+static uint64_t
+transfer_cycles(avr_state *state)
+{
+    static const uint8_t dividers[] = {4, 16, 64, 128};
+    uint64_t divider = dividers[state->io_registers[SPCR] & ((1 << SPR1) | (1 << SPR0))];
+    if (state->io_registers[SPSR] & (1 << SPI2X))
+        divider /= 2;
+    return 8 * divider;
+}
+
+void
+avr_spi_reset(avr_state *state)
+{
+    memset(&state->spi, 0, sizeof(state->spi));
+    state->spi.next_event = UINT64_MAX;
+}
+
+void
+avr_spi_update(avr_state *state)
+{
+    avr_spi *spi = &state->spi;
+    uint8_t *io = state->io_registers;
+    uint64_t next_event = UINT64_MAX;
+
+    if (io[SPCR] & (1 << SPE)) {
+        if (io[SPCR] & (1 << MSTR)) {
+            // the master clocks in the answer of the slave, a linked one may still be on its way
+            if (spi->busy && state->cycles >= spi->done && (!spi->linked || avr_ring_count(&spi->rx))) {
+                if (avr_ring_pop(&spi->rx, &spi->data, 1) == 0)
+                    spi->data = SPI_IDLE_BYTE;
+                spi->busy = 0;
+                io[SPSR] |= 1 << SPIF;
+            } else if (spi->busy && state->cycles < spi->done) {
+                next_event = spi->done;
+            }
+        } else if (!(io[SPSR] & (1 << SPIF)) && avr_ring_pop(&spi->rx, &spi->data, 1)) {
+            // a slave takes the next byte once the previous one was read
+            io[SPSR] |= 1 << SPIF;
+        }
+    }
+    spi->next_event = next_event;
+}
+
+uint8_t
+avr_spi_read_spdr(avr_core *core)
+{
+    avr_state *state = core->state;
+
+    state->io_registers[SPSR] &= ~((1 << SPIF) | (1 << WCOL));
+    state->spi.next_event = 0;
+    return state->spi.data;
+}
+
+// a master starts a transfer, a slave loads the answer for the next one
+void
+avr_spi_write_spdr(avr_core *core, uint8_t value)
+{
+    avr_state *state = core->state;
+    avr_spi *spi = &state->spi;
+
+    if (!(state->io_registers[SPCR] & (1 << SPE)))
+        return;
+    if (spi->busy) {
+        state->io_registers[SPSR] |= 1 << WCOL;
+        return;
+    }
+
+    state->io_registers[SPSR] &= ~((1 << SPIF) | (1 << WCOL));
+    if (!(state->io_registers[SPCR] & (1 << MSTR))) {
+        spi->shift = value;
+        return;
+    }
+    avr_ring_push(&spi->tx, &value, 1);
+    spi->busy = 1;
+    spi->done = state->cycles + transfer_cycles(state);
+    spi->next_event = 0;
+}
+
+/* Bytes from the master. Each one swaps places with the slave shift register, so every byte
+   is answered with what the slave loaded into SPDR before it arrived, or with the previous
+   byte if it loaded nothing. A slave that is not enabled leaves MISO idle. */
+void
+avr_spi_slave_receive(avr_state *state, const uint8_t *data, uint32_t length)
+{
+    avr_spi *spi = &state->spi;
+    uint8_t control = state->io_registers[SPCR];
+
+    for (uint32_t i = 0; i < length; i++) {
+        uint8_t answer = SPI_IDLE_BYTE;
+        if ((control & (1 << SPE)) && !(control & (1 << MSTR))) {
+            answer = spi->shift;
+            spi->shift = data[i];
+        }
+        avr_ring_push(&spi->rx, &data[i], 1);
+        avr_ring_push(&spi->tx, &answer, 1);
+    }
+    spi->next_event = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef AVR_SPI
+#define AVR_SPI
+
+#include "avr_core.h"
+
+// I/O addresses of the SPI, ATmega8/16/32 layout
+#define SPCR    (0x0D)
+#define SPSR    (0x0E)
+#define SPDR    (0x0F)
+
+// SPCR bits
+#define SPIE    (7)
+#define SPE     (6)
+#define DORD    (5)
+#define MSTR    (4)
+#define SPR1    (1)
+#define SPR0    (0)
+
+// SPSR bits
+#define SPIF    (7)
+#define WCOL    (6)
+#define SPI2X   (0)
+
+#define SPSR_WRITABLE (1 << SPI2X)
+
+// MISO level when no slave answers
+#define SPI_IDLE_BYTE (0xFF)
+
+void avr_spi_reset(avr_state *state);
+void avr_spi_update(avr_state *state);
+uint8_t avr_spi_read_spdr(avr_core *core);
+void avr_spi_write_spdr(avr_core *core, uint8_t value);
+void avr_spi_slave_receive(avr_state *state, const uint8_t *data, uint32_t length);
+
+// called after every instruction, keep the common case to a single compare
+static inline void
+avr_spi_tick(avr_core *core)
+{
+    if (core->state->cycles >= core->state->spi.next_event)
+        avr_spi_update(core->state);
+}
+
+#endif
@@ -0,0 +1,225 @@
+/* EEPROM, flash self programming and backing files, see avr_storage.h */
+
+#include "avr_storage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// erased flash and EEPROM cells read as ones
+#define ERASED (0xFF)
+
+void
+avr_storage_reset(avr_state *state)
+{
+    memset(&state->eeprom, 0, sizeof(state->eeprom));
+    memset(state->eeprom.data, ERASED, EEPROM_SIZE);
+    memset(state->spm_buffer, ERASED, sizeof(state->spm_buffer));
+}
+
+static int
+writable(const avr_mapping *mapping)
+{
+    return mapping->data != NULL && mapping->mode != AVR_MAP_READ;
+}
+
+// EEWE and EEMWE clear themselves, there is no tick for it, the bits are updated when EECR is accessed
+static void
+eeprom_update(avr_state *state)
+{
+    uint8_t *eecr = &state->io_registers[EECR];
+
+    if ((*eecr & (1 << EEWE)) && state->cycles >= state->eeprom.write_done)
+        *eecr &= ~(1 << EEWE);
+    if ((*eecr & (1 << EEMWE)) && state->cycles > state->eeprom.master_until)
+        *eecr &= ~(1 << EEMWE);
+}
+
+uint8_t
+avr_eeprom_read_eecr(avr_core *core)
+{
+    eeprom_update(core->state);
+    return core->state->io_registers[EECR];
+}
+
+// EEMWE arms a write for a few cycles, EEWE then writes EEDR, EERE reads into EEDR
+void
+avr_eeprom_write_eecr(avr_core *core, uint8_t value)
+{
+    avr_state *state = core->state;
+    uint8_t *io = state->io_registers;
+
+    eeprom_update(state);
+    uint8_t eecr = io[EECR] & ((1 << EEWE) | (1 << EEMWE));
+    uint16_t address = ((io[EEARH] << 8) | io[EEARL]) & (EEPROM_SIZE - 1);
+
+    // the write needs EEMWE from an earlier access, setting both at once does not write
+    if ((value & (1 << EEWE)) && (eecr & (1 << EEMWE)) && !(eecr & (1 << EEWE))) {
+        avr_eeprom_store(core, address, io[EEDR]);
+        eecr |= 1 << EEWE;
+        state->eeprom.write_done = state->cycles + EEPROM_WRITE_CYCLES;
+    }
+    if (value & (1 << EEMWE)) {
+        eecr |= 1 << EEMWE;
+        state->eeprom.master_until = state->cycles + EEPROM_MASTER_CYCLES;
+    }
+    if ((value & (1 << EERE)) && !(eecr & (1 << EEWE)))
+        io[EEDR] = state->eeprom.data[address];
+
+    io[EECR] = eecr | (value & (1 << EERIE));
+}
+
+void
+avr_eeprom_store(avr_core *core, uint16_t address, uint8_t value)
+{
+    core->state->eeprom.data[address] = value;
+    if (writable(&core->eeprom_file) && address < core->eeprom_file.length)
+        core->eeprom_file.data[address] = value;
+}
+
+/* Self programming as on the ATmega8 without the timing, SPM with SPMEN fills the page buffer
+   from r1:r0, with PGERS erases the page Z points to and with PGWRT writes the buffer to it. */
+void
+avr_spm(avr_core *core)
+{
+    avr_state *state = core->state;
+    uint8_t spmcr = state->io_registers[SPMCR];
+    uint16_t z = (state->registers[31] << 8) | state->registers[30];
+    uint16_t address = (z >> 1) % PROGRAM_MEMORY_SIZE;
+    uint16_t page = address & ~(SPM_PAGE_SIZE - 1);
+
+    if (!(spmcr & (1 << SPMEN)))
+        return;
+
+    switch (spmcr & ((1 << PGWRT) | (1 << PGERS))) {
+    case 0:
+        state->spm_buffer[address % SPM_PAGE_SIZE] = (state->registers[1] << 8) | state->registers[0];
+        break;
+    case 1 << PGERS:
+        for (int i = 0; i < SPM_PAGE_SIZE; i++)
+            avr_flash_store(core, page + i, 0xFFFF);
+        break;
+    case 1 << PGWRT:
+        for (int i = 0; i < SPM_PAGE_SIZE; i++)
+            avr_flash_store(core, page + i, state->spm_buffer[i]);
+        memset(state->spm_buffer, ERASED, sizeof(state->spm_buffer));
+        break;
+    }
+    state->io_registers[SPMCR] &= ~((1 << PGWRT) | (1 << PGERS) | (1 << SPMEN));
+}
+
+// flash words are little endian in the file
+void
+avr_flash_store(avr_core *core, uint16_t address, uint16_t word)
+{
+    core->state->program_memory[address] = word;
+    if (writable(&core->flash_file) && 2 * (size_t)address + 1 < core->flash_file.length) {
+        core->flash_file.data[2 * address] = word & 0xFF;
+        core->flash_file.data[2 * address + 1] = word >> 8;
+    }
+}
+
+// map up to size bytes of path, a writable mapping grows a short file with erased cells
+static int
+map_file(avr_mapping *mapping, const char *path, size_t size, int mode)
+{
+    struct stat st;
+    size_t length;
+    void *data;
+
+    if (mode != AVR_MAP_READ && mode != AVR_MAP_WRITE && mode != AVR_MAP_COPY) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = open(path, mode == AVR_MAP_WRITE ? O_RDWR | O_CREAT : O_RDONLY, 0666);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+
+    size_t existing = (size_t)st.st_size < size ? (size_t)st.st_size : size;
+    length = existing;
+    if (mode == AVR_MAP_WRITE && length < size) {
+        if (ftruncate(fd, size) < 0)
+            goto fail;
+        length = size;
+    }
+    if (length == 0) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    // a private mapping is writable even though the file is opened read only
+    data = mmap(NULL, length, mode == AVR_MAP_READ ? PROT_READ : PROT_READ | PROT_WRITE,
+                mode == AVR_MAP_COPY ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        goto fail;
+    close(fd);
+
+    memset((uint8_t *)data + existing, ERASED, length - existing);
+    mapping->data = data;
+    mapping->length = length;
+    mapping->mode = mode;
+    return 0;
+
+fail:;
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+}
+
+static void
+unmap_file(avr_mapping *mapping)
+{
+    if (mapping->data != NULL)
+        munmap(mapping->data, mapping->length);
+    memset(mapping, 0, sizeof(*mapping));
+}
+
+// load the program memory from a file of little endian words, returns the words read
+int
+avr_attach_flash(avr_core *core, const char *path, int mode)
+{
+    avr_mapping mapping;
+
+    if (map_file(&mapping, path, 2 * PROGRAM_MEMORY_SIZE, mode) < 0)
+        return -1;
+    unmap_file(&core->flash_file);
+    core->flash_file = mapping;
+
+    size_t words = mapping.length / 2;
+    for (size_t i = 0; i < words; i++)
+        core->state->program_memory[i] = mapping.data[2 * i] | (mapping.data[2 * i + 1] << 8);
+    return (int)words;
+}
+
+// load the EEPROM from a file, returns the bytes read
+int
+avr_attach_eeprom(avr_core *core, const char *path, int mode)
+{
+    avr_mapping mapping;
+
+    if (map_file(&mapping, path, EEPROM_SIZE, mode) < 0)
+        return -1;
+    unmap_file(&core->eeprom_file);
+    core->eeprom_file = mapping;
+
+    memcpy(core->state->eeprom.data, mapping.data, mapping.length);
+    return (int)mapping.length;
+}
+
+void
+avr_detach_flash(avr_core *core)
+{
+    unmap_file(&core->flash_file);
+}
+
+void
+avr_detach_eeprom(avr_core *core)
+{
+    unmap_file(&core->eeprom_file);
+}
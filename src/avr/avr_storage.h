@@ -0,0 +1,50 @@
+#ifndef AVR_STORAGE
+#define AVR_STORAGE
+
+#include "avr_core.h"
+
+/* Non volatile memories, the EEPROM, flash self programming and files backing both. The machine
+   state always holds the contents, an attached file is read into it and then sees every write
+   of the firmware. Restoring an older state does not undo what already reached the file. */
+
+// I/O addresses of the EEPROM, ATmega8/16/32 layout
+#define EECR    (0x1C)
+#define EEDR    (0x1D)
+#define EEARL   (0x1E)
+#define EEARH   (0x1F)
+
+// EECR bits
+#define EERIE   (3)
+#define EEMWE   (2)
+#define EEWE    (1)
+#define EERE    (0)
+
+// cycles of an EEPROM write, the datasheet count at the 1 MHz default clock
+#define EEPROM_WRITE_CYCLES (8448)
+
+// cycles after EEMWE is set during which EEWE starts a write
+#define EEPROM_MASTER_CYCLES (4)
+
+// I/O address of the store program memory control register
+#define SPMCR   (0x37)
+
+// SPMCR bits
+#define PGWRT   (2)
+#define PGERS   (1)
+#define SPMEN   (0)
+
+void avr_storage_reset(avr_state *state);
+
+uint8_t avr_eeprom_read_eecr(avr_core *core);
+void avr_eeprom_write_eecr(avr_core *core, uint8_t value);
+void avr_eeprom_store(avr_core *core, uint16_t address, uint8_t value);
+
+void avr_spm(avr_core *core);
+void avr_flash_store(avr_core *core, uint16_t address, uint16_t word);
+
+int avr_attach_flash(avr_core *core, const char *path, int mode);
+int avr_attach_eeprom(avr_core *core, const char *path, int mode);
+void avr_detach_flash(avr_core *core);
+void avr_detach_eeprom(avr_core *core);
+
+#endif
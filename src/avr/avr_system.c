@@ -0,0 +1,276 @@
+/* Multi MCU systems, see avr_system.h */
+
+#include "avr_system.h"
+#include "avr_history.h"
+#include "avr_spi.h"
+#include "avr_uart.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+// a quantum adds at most one ring of bytes while the previous one is consumed
+#define QUEUE_SIZE (4 * UART_BUFFER_SIZE)
+
+#define PORT_COUNT (2)
+
+/* Single producer single consumer byte queue between two MCU threads. The producer appends
+   while it runs and publishes its head at the end of the quantum, the consumer takes exactly
+   the published bytes after the barrier, so neither side ever locks the queue and the result
+   does not depend on thread timing. */
+typedef struct {
+    uint8_t     data[QUEUE_SIZE];
+    uint32_t    head;           /* written by the producer only */
+    uint32_t    tail;           /* written by the consumer only */
+    uint32_t    published[2];   /* head at the end of even and odd quanta */
+} spsc_queue;
+
+typedef struct {
+    int         kind;
+    int         from;
+    int         to;
+    int         mosi;           /* the SPI master sends to the slave, which answers each byte */
+    spsc_queue  queue;
+} channel;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             count;
+    int             waiting;
+    unsigned        generation;
+    int             gate;           /* 0 until all workers exist, then 1 to run or -1 to quit */
+} barrier;
+
+typedef struct {
+    avr_core    **cores;
+    int         count;
+    channel     *channels;
+    int         channel_count;
+    uint64_t    cycles;
+    uint64_t    quantum;
+    barrier     barrier;
+} system_run;
+
+typedef struct {
+    system_run  *run;
+    int         index;
+} worker_arg;
+
+// pthread_barrier_t is missing on macOS
+static void
+barrier_wait(barrier *b)
+{
+    pthread_mutex_lock(&b->lock);
+    unsigned generation = b->generation;
+    if (++b->waiting == b->count) {
+        b->waiting = 0;
+        b->generation++;
+        pthread_cond_broadcast(&b->cond);
+    } else {
+        while (generation == b->generation)
+            pthread_cond_wait(&b->cond, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static avr_ring *
+outgoing(avr_state *state, int kind)
+{
+    return kind == AVR_LINK_UART ? &state->uart.tx : &state->spi.tx;
+}
+
+static void
+deliver(avr_state *state, const channel *c, const uint8_t *data, uint32_t length)
+{
+    // bytes that don't fit are lost, as with a receiver that isn't read in time
+    if (c->kind == AVR_LINK_UART) {
+        avr_uart_rx_push(state, data, length);
+    } else if (c->mosi) {
+        avr_spi_slave_receive(state, data, length);
+    } else {
+        avr_ring_push(&state->spi.rx, data, length);
+        state->spi.next_event = 0;
+    }
+}
+
+// move what the MCU sent into the queues of its links, a port linked twice sends to both
+static void
+produce(system_run *run, int index, uint64_t quantum)
+{
+    avr_state *state = run->cores[index]->state;
+    uint8_t data[UART_BUFFER_SIZE];
+
+    for (int kind = 0; kind < PORT_COUNT; kind++) {
+        uint32_t length = 0;
+        int linked = 0;
+
+        for (int i = 0; i < run->channel_count; i++) {
+            channel *c = &run->channels[i];
+            if (c->from != index || c->kind != kind)
+                continue;
+            if (!linked)
+                length = avr_ring_pop(outgoing(state, kind), data, sizeof(data));
+            linked = 1;
+
+            for (uint32_t j = 0; j < length; j++)
+                c->queue.data[(c->queue.head + j) % QUEUE_SIZE] = data[j];
+            c->queue.head += length;
+        }
+    }
+    for (int i = 0; i < run->channel_count; i++) {
+        if (run->channels[i].from == index)
+            run->channels[i].queue.published[quantum & 1] = run->channels[i].queue.head;
+    }
+}
+
+// deliver the bytes published for the MCU in this quantum
+static void
+consume(system_run *run, int index, uint64_t quantum)
+{
+    avr_core *core = run->cores[index];
+    avr_state *state = core->state;
+    uint8_t data[QUEUE_SIZE];
+
+    for (int i = 0; i < run->channel_count; i++) {
+        channel *c = &run->channels[i];
+        if (c->to != index)
+            continue;
+
+        uint32_t end = c->queue.published[quantum & 1];
+        uint32_t length = end - c->queue.tail;
+        for (uint32_t j = 0; j < length; j++)
+            data[j] = c->queue.data[(c->queue.tail + j) % QUEUE_SIZE];
+        c->queue.tail = end;
+        if (length == 0)
+            continue;
+        deliver(state, c, data, length);
+        // bus traffic is an input from outside, history replays must not run across it
+        avr_history_mark(core);
+    }
+}
+
+static void *
+worker(void *arg)
+{
+    system_run *run = ((worker_arg *)arg)->run;
+    int index = ((worker_arg *)arg)->index;
+    avr_core *core = run->cores[index];
+    uint64_t start = core->state->cycles;
+
+    pthread_mutex_lock(&run->barrier.lock);
+    while (run->barrier.gate == 0)
+        pthread_cond_wait(&run->barrier.cond, &run->barrier.lock);
+    pthread_mutex_unlock(&run->barrier.lock);
+    if (run->barrier.gate < 0)
+        return NULL;
+
+    for (uint64_t quantum = 0, done = 0; done < run->cycles; quantum++) {
+        done = run->cycles - done > run->quantum ? done + run->quantum : run->cycles;
+        if (core->state->cycles < start + done)
+            avr_run(core, start + done - core->state->cycles, AVR_UNLIMITED);
+
+        produce(run, index, quantum);
+        barrier_wait(&run->barrier);
+        consume(run, index, quantum);
+    }
+    return NULL;
+}
+
+// run every MCU for cycles, one thread each, returns -1 with errno set on failure
+int
+avr_system_run(avr_core **cores, int count, const avr_link *links, int link_count,
+               uint64_t cycles, uint64_t quantum)
+{
+    if (count < 1 || link_count < 0 || quantum == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < i; j++) {
+            if (cores[i]->state == cores[j]->state) {
+                errno = EINVAL;
+                return -1;
+            }
+        }
+    }
+    for (int i = 0; i < link_count; i++) {
+        const avr_link *link = &links[i];
+        if ((link->kind != AVR_LINK_UART && link->kind != AVR_LINK_SPI) || link->a == link->b
+                || link->a < 0 || link->a >= count || link->b < 0 || link->b >= count) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    system_run run;
+    memset(&run, 0, sizeof(run));
+    run.cores = cores;
+    run.count = count;
+    run.channel_count = 2 * link_count;
+    run.cycles = cycles;
+    run.quantum = quantum;
+
+    pthread_t *threads = malloc(count * sizeof(pthread_t));
+    worker_arg *args = malloc(count * sizeof(worker_arg));
+    run.channels = calloc(run.channel_count ? run.channel_count : 1, sizeof(channel));
+    if (threads == NULL || args == NULL || run.channels == NULL) {
+        free(threads);
+        free(args);
+        free(run.channels);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (int i = 0; i < run.channel_count; i++) {
+        const avr_link *link = &links[i / 2];
+        run.channels[i].kind = link->kind;
+        run.channels[i].from = i % 2 ? link->b : link->a;
+        run.channels[i].to = i % 2 ? link->a : link->b;
+        run.channels[i].mosi = link->kind == AVR_LINK_SPI && i % 2 == 0;
+    }
+
+    // a linked master finishes a byte once the answer of the slave arrived, at the next quantum
+    for (int i = 0; i < link_count; i++) {
+        if (links[i].kind == AVR_LINK_SPI)
+            cores[links[i].a]->state->spi.linked = 1;
+    }
+
+    pthread_mutex_init(&run.barrier.lock, NULL);
+    pthread_cond_init(&run.barrier.cond, NULL);
+    run.barrier.count = count;
+
+    // every MCU has to reach each barrier, so nothing runs unless all threads started
+    int started = 0;
+    for (; started < count; started++) {
+        args[started] = (worker_arg){&run, started};
+        if (pthread_create(&threads[started], NULL, worker, &args[started]) != 0)
+            break;
+    }
+    pthread_mutex_lock(&run.barrier.lock);
+    run.barrier.gate = started == count ? 1 : -1;
+    pthread_cond_broadcast(&run.barrier.cond);
+    pthread_mutex_unlock(&run.barrier.lock);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    // a transfer still waiting for its answer completes with the idle byte when run alone
+    for (int i = 0; i < link_count; i++) {
+        if (links[i].kind == AVR_LINK_SPI) {
+            cores[links[i].a]->state->spi.linked = 0;
+            cores[links[i].a]->state->spi.next_event = 0;
+        }
+    }
+
+    pthread_cond_destroy(&run.barrier.cond);
+    pthread_mutex_destroy(&run.barrier.lock);
+    free(threads);
+    free(args);
+    free(run.channels);
+    if (started < count) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
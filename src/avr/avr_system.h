@@ -0,0 +1,23 @@
+#ifndef AVR_SYSTEM
+#define AVR_SYSTEM
+
+#include "avr_core.h"
+
+/* Several MCUs wired together. Every MCU runs on its own thread for a quantum of cycles,
+   bytes sent over a link in one quantum are delivered at its end. A smaller quantum is closer
+   to the real timing, a larger one synchronizes less often. */
+
+// link kinds, both directions of a link are connected
+#define AVR_LINK_UART   (0)     /* TXD of each side to RXD of the other */
+#define AVR_LINK_SPI    (1)     /* a is the master, MOSI to b and MISO back, one answer per byte */
+
+typedef struct {
+    int         kind;
+    int         a;              /* index of the first MCU */
+    int         b;              /* index of the second MCU */
+} avr_link;
+
+int avr_system_run(avr_core **cores, int count, const avr_link *links, int link_count,
+                   uint64_t cycles, uint64_t quantum);
+
+#endif
@@ -0,0 +1,140 @@
+#include "avr_uart.h"
+
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#endif
+
+// cycles needed to shift one frame at the configured baud rate
+static uint64_t
+frame_cycles(avr_state *state)
+{
+    uint16_t ubrr = ((state->io_registers[UBRRH] & 0x0F) << 8) | state->io_registers[UBRRL];
+    uint64_t bit_cycles = (uint64_t)(ubrr + 1) * ((state->io_registers[UCSRA] & (1 << U2X)) ? 8 : 16);
+    return bit_cycles * UART_FRAME_BITS;
+}
+
+void
+avr_uart_reset(avr_state *state)
+{
+    memset(&state->uart, 0, sizeof(state->uart));
+    state->io_registers[UCSRA] = 1 << UDRE;
+}
+
+void
+avr_uart_update(avr_state *state)
+{
+    avr_uart *uart = &state->uart;
+    uint8_t *io = state->io_registers;
+    uint64_t next_event = UINT64_MAX;
+
+    // transmitter
+    if (!(io[UCSRA] & (1 << UDRE))) {
+        if (state->cycles >= uart->tx_done)
+            io[UCSRA] |= (1 << UDRE) | (1 << TXC);
+        else
+            next_event = uart->tx_done;
+    }
+
+    // receiver, a new byte enters UDR once the previous one was read
+    if ((io[UCSRB] & (1 << RXEN)) && !(io[UCSRA] & (1 << RXC)) && avr_ring_count(&uart->rx)) {
+        if (state->cycles >= uart->rx_ready) {
+            avr_ring_pop(&uart->rx, &uart->rx_data, 1);
+            io[UCSRA] |= 1 << RXC;
+            uart->rx_ready = state->cycles + frame_cycles(state);
+        } else if (uart->rx_ready < next_event) {
+            next_event = uart->rx_ready;
+        }
+    }
+
+    uart->next_event = next_event;
+}
+
+uint8_t
+avr_uart_read_udr(avr_core *core)
+{
+    avr_state *state = core->state;
+
+    state->io_registers[UCSRA] &= ~(1 << RXC);
+    state->uart.next_event = 0;
+    return state->uart.rx_data;
+}
+
+void
+avr_uart_write_udr(avr_core *core, uint8_t value)
+{
+    avr_state *state = core->state;
+    avr_uart *uart = &state->uart;
+
+    // the hardware ignores writes while the transmitter is disabled or busy
+    if (!(state->io_registers[UCSRB] & (1 << TXEN)) || !(state->io_registers[UCSRA] & (1 << UDRE)))
+        return;
+
+    if (avr_ring_free(&uart->tx) == 0) {
+        if (core->uart_tx_fd >= 0)
+            avr_uart_flush(core);
+        else if (core->uart_tx_drain)
+            uart->tx.tail = uart->tx.head;
+    }
+
+    if (avr_ring_push(&uart->tx, &value, 1) == 0)
+        uart->tx_overruns += 1;
+
+    state->io_registers[UCSRA] &= ~((1 << UDRE) | (1 << TXC));
+    uart->tx_done = state->cycles + frame_cycles(state);
+    uart->next_event = 0;
+}
+
+uint32_t
+avr_uart_rx_push(avr_state *state, const uint8_t *data, uint32_t length)
+{
+    state->uart.next_event = 0;
+    return avr_ring_push(&state->uart.rx, data, length);
+}
+
+uint32_t
+avr_uart_rx_pending(avr_state *state)
+{
+    return avr_ring_count(&state->uart.rx);
+}
+
+uint32_t
+avr_uart_tx_pop(avr_state *state, uint8_t *data, uint32_t length)
+{
+    return avr_ring_pop(&state->uart.tx, data, length);
+}
+
+uint32_t
+avr_uart_tx_pending(avr_state *state)
+{
+    return avr_ring_count(&state->uart.tx);
+}
+
+// write everything in the tx ring to the tx descriptor, returns -1 and sets errno on failure
+int
+avr_uart_flush(avr_core *core)
+{
+    avr_ring *ring = &core->state->uart.tx;
+
+    if (core->uart_tx_fd < 0)
+        return 0;
+
+    while (avr_ring_count(ring)) {
+        uint32_t start = avr_ring_index(ring->tail);
+        uint32_t length = UART_BUFFER_SIZE - start;
+        if (length > avr_ring_count(ring))
+            length = avr_ring_count(ring);
+
+        long written = (long)write(core->uart_tx_fd, &ring->data[start], length);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        ring->tail += (uint32_t)written;
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef AVR_UART
+#define AVR_UART
+
+#include "avr_core.h"
+
+// I/O addresses of the USART, ATmega8/16/32 layout
+#define UBRRL   (0x09)
+#define UCSRB   (0x0A)
+#define UCSRA   (0x0B)
+#define UDR     (0x0C)
+#define UBRRH   (0x20)
+
+// UCSRA bits
+#define RXC     (7)
+#define TXC     (6)
+#define UDRE    (5)
+#define U2X     (1)
+#define MPCM    (0)
+
+#define UCSRA_WRITABLE ((1 << U2X) | (1 << MPCM))
+
+// UCSRB bits
+#define RXEN    (4)
+#define TXEN    (3)
+
+// start bit, 8 data bits, stop bit
+#define UART_FRAME_BITS (10)
+
+void avr_uart_reset(avr_state *state);
+void avr_uart_update(avr_state *state);
+uint8_t avr_uart_read_udr(avr_core *core);
+void avr_uart_write_udr(avr_core *core, uint8_t value);
+
+uint32_t avr_uart_rx_push(avr_state *state, const uint8_t *data, uint32_t length);
+uint32_t avr_uart_rx_pending(avr_state *state);
+uint32_t avr_uart_tx_pop(avr_state *state, uint8_t *data, uint32_t length);
+uint32_t avr_uart_tx_pending(avr_state *state);
+int avr_uart_flush(avr_core *core);
+
+// called after every instruction, keep the common case to a single compare
+static inline void
+avr_uart_tick(avr_core *core)
+{
+    if (core->state->cycles >= core->state->uart.next_event)
+        avr_uart_update(core->state);
+}
+
+#endif
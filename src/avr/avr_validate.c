@@ -0,0 +1,219 @@
+/* Differential validation, see avr_validate.h */
+
+#include "avr_validate.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+// every member of avr_state by name, padding is left out so it never counts as a difference
+static const struct {
+    const char  *name;
+    size_t      offset;
+    size_t      count;
+    size_t      width;
+} fields[] = {
+    {"sreg",                offsetof(avr_state, sreg),                  1,                      1},
+    {"registers",           offsetof(avr_state, registers),             REGISTER_SIZE,          1},
+    {"io_registers",        offsetof(avr_state, io_registers),          IO_REGISTER_SIZE,       1},
+    {"sram",                offsetof(avr_state, sram),                  SRAM_SIZE,              1},
+    {"program_memory",      offsetof(avr_state, program_memory),        PROGRAM_MEMORY_SIZE,    2},
+    {"program_counter",     offsetof(avr_state, program_counter),       1,                      2},
+    {"break_point_reached", offsetof(avr_state, break_point_reached),   1,                      1},
+    {"cycles",              offsetof(avr_state, cycles),                1,                      8},
+    {"instructions",        offsetof(avr_state, instructions),          1,                      8},
+    {"eeprom",              offsetof(avr_state, eeprom.data),           EEPROM_SIZE,            1},
+    {"eeprom_write_done",   offsetof(avr_state, eeprom.write_done),     1,                      8},
+    {"eeprom_master_until", offsetof(avr_state, eeprom.master_until),   1,                      8},
+    {"spm_buffer",          offsetof(avr_state, spm_buffer),            SPM_PAGE_SIZE,          2},
+    {"uart.rx.data",        offsetof(avr_state, uart.rx.data),          UART_BUFFER_SIZE,       1},
+    {"uart.rx.head",        offsetof(avr_state, uart.rx.head),          1,                      4},
+    {"uart.rx.tail",        offsetof(avr_state, uart.rx.tail),          1,                      4},
+    {"uart.tx.data",        offsetof(avr_state, uart.tx.data),          UART_BUFFER_SIZE,       1},
+    {"uart.tx.head",        offsetof(avr_state, uart.tx.head),          1,                      4},
+    {"uart.tx.tail",        offsetof(avr_state, uart.tx.tail),          1,                      4},
+    {"uart.tx_done",        offsetof(avr_state, uart.tx_done),          1,                      8},
+    {"uart.rx_ready",       offsetof(avr_state, uart.rx_ready),         1,                      8},
+    {"uart.next_event",     offsetof(avr_state, uart.next_event),       1,                      8},
+    {"uart.tx_overruns",    offsetof(avr_state, uart.tx_overruns),      1,                      8},
+    {"uart.rx_data",        offsetof(avr_state, uart.rx_data),          1,                      1},
+    {"spi.rx.data",         offsetof(avr_state, spi.rx.data),           UART_BUFFER_SIZE,       1},
+    {"spi.rx.head",         offsetof(avr_state, spi.rx.head),           1,                      4},
+    {"spi.rx.tail",         offsetof(avr_state, spi.rx.tail),           1,                      4},
+    {"spi.tx.data",         offsetof(avr_state, spi.tx.data),           UART_BUFFER_SIZE,       1},
+    {"spi.tx.head",         offsetof(avr_state, spi.tx.head),           1,                      4},
+    {"spi.tx.tail",         offsetof(avr_state, spi.tx.tail),           1,                      4},
+    {"spi.done",            offsetof(avr_state, spi.done),              1,                      8},
+    {"spi.next_event",      offsetof(avr_state, spi.next_event),        1,                      8},
+    {"spi.busy",            offsetof(avr_state, spi.busy),              1,                      1},
+    {"spi.data",            offsetof(avr_state, spi.data),              1,                      1},
+    {"spi.shift",           offsetof(avr_state, spi.shift),             1,                      1},
+    {"spi.linked",          offsetof(avr_state, spi.linked),            1,                      1},
+};
+
+static uint64_t
+field_value(const uint8_t *field, size_t width)
+{
+    uint8_t byte;
+    uint16_t word;
+    uint32_t dword;
+    uint64_t value;
+
+    switch (width) {
+    case 1:
+        memcpy(&byte, field, 1);
+        return byte;
+    case 2:
+        memcpy(&word, field, 2);
+        return word;
+    case 4:
+        memcpy(&dword, field, 4);
+        return dword;
+    case 8:
+        memcpy(&value, field, 8);
+        return value;
+    }
+    return 0;
+}
+
+// store up to capacity differences, returns how many there are in total
+size_t
+avr_state_diff_list(const avr_state *reference, const avr_state *backend,
+                    avr_state_diff *diffs, size_t capacity)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        const uint8_t *a = (const uint8_t *)reference + fields[i].offset;
+        const uint8_t *b = (const uint8_t *)backend + fields[i].offset;
+
+        // arrays have no padding, most fields agree as a whole
+        if (memcmp(a, b, fields[i].count * fields[i].width) == 0)
+            continue;
+        for (size_t j = 0; j < fields[i].count; j++) {
+            uint64_t value_a = field_value(a + j * fields[i].width, fields[i].width);
+            uint64_t value_b = field_value(b + j * fields[i].width, fields[i].width);
+            if (value_a == value_b)
+                continue;
+            if (count < capacity)
+                diffs[count] = (avr_state_diff){fields[i].name, fields[i].count > 1 ? (int)j : -1,
+                                                value_a, value_b};
+            count++;
+        }
+    }
+    return count;
+}
+
+// avr_run, the pre-decoded engine, context is unused
+uint64_t
+avr_run_backend(void *context, avr_core *core, uint64_t max_cycles, uint64_t max_instructions)
+{
+    (void)context;
+    return avr_run(core, max_cycles, max_instructions);
+}
+
+// avr_run that flips the fault in when the instruction counter reaches the avr_injection context
+uint64_t
+avr_run_injected(void *context, avr_core *core, uint64_t max_cycles, uint64_t max_instructions)
+{
+    const avr_injection *injection = context;
+    avr_state *state = core->state;
+    uint64_t start = state->cycles;
+    uint64_t executed = 0;
+
+    if (state->instructions < injection->instructions) {
+        uint64_t until = injection->instructions - state->instructions;
+        executed = avr_run(core, max_cycles, until < max_instructions ? until : max_instructions);
+        if (state->instructions != injection->instructions)
+            return executed;
+        avr_fault_inject(state, &injection->fault);
+        if (max_cycles != AVR_UNLIMITED)
+            max_cycles = state->cycles - start >= max_cycles ? 0 : max_cycles - (state->cycles - start);
+    }
+    if (executed == max_instructions || max_cycles == 0 || state->break_point_reached)
+        return executed;
+    return executed + avr_run(core, max_cycles, max_instructions - executed);
+}
+
+// the reference stops at BREAK like avr_run
+static uint64_t
+reference_run(avr_core *core, uint64_t max_instructions)
+{
+    uint64_t executed = 0;
+    while (executed < max_instructions && !core->state->break_point_reached) {
+        avr_run_instruction(core);
+        executed++;
+    }
+    return executed;
+}
+
+// run both from start for the given instructions, returns 1 if they end up different
+static int
+run_both(const avr_state *start, avr_backend backend, void *context, uint64_t instructions,
+         avr_core *reference, avr_core *result)
+{
+    memcpy(reference->state, start, sizeof(avr_state));
+    memcpy(result->state, start, sizeof(avr_state));
+    reference_run(reference, instructions);
+    backend(context, result, AVR_UNLIMITED, instructions);
+    return avr_state_diff_list(reference->state, result->state, NULL, 0) != 0;
+}
+
+/* Run up to max_instructions from start, stopping at BREAK, and return 0 if both sides agree
+   all the way. On a divergence return 1, divergence tells where, and reference and result hold
+   the states right after the diverging instruction. Returns -1 with errno set on failure. */
+int
+avr_validate(const avr_state *start, avr_backend backend, void *context, uint64_t max_instructions,
+             uint64_t block, avr_state *reference, avr_state *result, avr_divergence *divergence)
+{
+    avr_core reference_core, result_core;
+    avr_state *saved;
+    uint64_t done = 0;
+
+    if (block == 0 || avr_state_check(start) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    saved = malloc(sizeof(avr_state));
+    if (saved == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    avr_core_init(&reference_core, reference);
+    avr_core_init(&result_core, result);
+    memcpy(reference, start, sizeof(avr_state));
+    memcpy(result, start, sizeof(avr_state));
+
+    while (done < max_instructions && !reference->break_point_reached) {
+        uint64_t length = max_instructions - done < block ? max_instructions - done : block;
+
+        // both sides agree here, so either one is the start of the block
+        memcpy(saved, reference, sizeof(avr_state));
+        reference_run(&reference_core, length);
+        backend(context, &result_core, AVR_UNLIMITED, length);
+        // only the block end is compared, a divergence that heals within the block goes unseen
+        if (avr_state_diff_list(reference, result, NULL, 0) == 0) {
+            done += length;
+            continue;
+        }
+
+        // after low instructions the states agree, after high they don't, assuming a divergence
+        // stays once it happened, otherwise this finds one of them but not necessarily the first
+        uint64_t low = 0, high = length;
+        while (high - low > 1) {
+            uint64_t middle = low + (high - low) / 2;
+            if (run_both(saved, backend, context, middle, &reference_core, &result_core))
+                high = middle;
+            else
+                low = middle;
+        }
+        run_both(saved, backend, context, low, &reference_core, &result_core);
+        divergence->instructions = reference->instructions;
+        divergence->program_counter = reference->program_counter;
+        divergence->instruction = reference->program_memory[reference->program_counter];
+        run_both(saved, backend, context, high, &reference_core, &result_core);
+        free(saved);
+        return 1;
+    }
+    free(saved);
+    return 0;
+}
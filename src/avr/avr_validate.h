@@ -0,0 +1,48 @@
+#ifndef AVR_VALIDATE
+#define AVR_VALIDATE
+
+#include "avr_core.h"
+#include "avr_fault.h"
+
+#include <stddef.h>
+
+/* Differential validation of an execution backend against avr_run_instruction, the reference.
+   Both run from the same state in blocks of instructions and their states are compared after
+   every block. When a block differs it is run again with bisection down to the first
+   instruction after which the states differ. States are only compared at block ends, so a
+   divergence that goes away again within a block is not seen; block 1 compares every
+   instruction. */
+
+// an execution backend, same contract as avr_run, context is passed through by avr_validate
+typedef uint64_t (*avr_backend)(void *context, avr_core *core, uint64_t max_cycles, uint64_t max_instructions);
+
+// context of avr_run_injected, checks the validation itself with a known divergence
+typedef struct {
+    uint64_t    instructions;   /* instruction counter value at which the fault is flipped in */
+    avr_fault   fault;          /* cycle is ignored */
+} avr_injection;
+
+// a field that differs between two states, peripheral members are named like uart.tx.head
+typedef struct {
+    const char  *field;
+    int         index;          /* element of an array field, -1 for a scalar */
+    uint64_t    reference;
+    uint64_t    backend;
+} avr_state_diff;
+
+typedef struct {
+    uint64_t    instructions;   /* instruction counter when the diverging instruction started */
+    uint16_t    program_counter;/* address of the diverging instruction */
+    uint16_t    instruction;    /* its flash word */
+} avr_divergence;
+
+size_t avr_state_diff_list(const avr_state *reference, const avr_state *backend,
+                           avr_state_diff *diffs, size_t capacity);
+
+uint64_t avr_run_backend(void *context, avr_core *core, uint64_t max_cycles, uint64_t max_instructions);
+uint64_t avr_run_injected(void *context, avr_core *core, uint64_t max_cycles, uint64_t max_instructions);
+
+int avr_validate(const avr_state *start, avr_backend backend, void *context, uint64_t max_instructions,
+                 uint64_t block, avr_state *reference, avr_state *result, avr_divergence *divergence);
+
+#endif
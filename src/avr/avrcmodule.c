@@ -1,32 +1,35 @@
 #include "Python.h"
 #include "avr_headers.h"
-
+#include "avr_uart.h"
+#include "avr_kernels.h"
+#include "avr_fault.h"
+#include "avr_system.h"
+#include "avr_storage.h"
+#include "avr_capi.h"
+#include "avr_block.h"
+#include "avr_validate.h"
+
+#include <errno.h>
 #include <stdint.h>
 /* AVRo objects */
 static PyTypeObject AVRo_Type;
 
 #define AVRoObject_Check(v)      Py_IS_TYPE(v, &AVRo_Type)
 
-#define get_bit(n,k) ((n & ( 1 << k )) >> k)
-
-#define g_rd3   (get_bit(rd,3))
-#define g_rr3   (get_bit(rr,3))
-#define g_r3    (get_bit(result,3))
+// cycles a worker thread runs between checks for cancellation
+#define ASYNC_SLICE_CYCLES (1 << 16)
 
-#define g_rd7   (get_bit(rd,7))
-#define g_rr7   (get_bit(rr,7))
-#define g_r7    (get_bit(result,7))
+// default busy wait before a paced deadline, trades cpu time for jitter
+#define PACED_SPIN_NS (50000)
 
-#define x_register ((self->registers[27] << 8) + self->registers[26])
-#define y_register ((self->registers[29] << 8) + self->registers[28])
-#define z_register ((self->registers[31] << 8) + self->registers[30])
+// default cycles between reverse execution checkpoints
+#define HISTORY_INTERVAL (1 << 16)
 
-#define instr_check(instruction, mask, operation) ((instruction & mask) == operation)
+// default cycles the MCUs of a system run between exchanging bus traffic
+#define SYSTEM_QUANTUM (1024)
 
-#define DEBUG
-
-#define NOT_IMPLEMENTED (0)
-#define GENERALIZATION_IMPLEMENTED (0)
+// default instructions validate runs between comparing the two engines
+#define VALIDATE_BLOCK (1024)
 
 
 // allocate memory
@@ -38,849 +41,1426 @@ newAVRoObject(PyObject *arg)
     if (self == NULL)
         return NULL;
     self->x_attr = NULL;
+    self->running = 0;
+    self->async_future = NULL;
+    self->async_cancel = 0;
+    self->coverage.obj = NULL;
+    self->block.obj = NULL;
+    memset(&self->record, 0, sizeof(self->record));
+
+    // set SREG, registers, io space, sram, program memory and counters to 0
+    avr_core_init(&self->core, &self->state);
+    avr_state_reset(&self->state);
+    return self;
+}
 
-    // set SREG to 0
-    self->sreg = 0;
-
-    self->break_point_reached = 0;
-
-    // set all registers to 0
-    memset(&self->registers, 0, REGISTER_SIZE);
-
-    // set io_registers to 0
-    memset(&self->io_registers, 0, IO_REGISTER_SIZE);
+/* AVRo methods */
 
-    // set sram to 0
-    memset(&self->sram, 0, SRAM_SIZE);
+// the state must not be touched while a run without the GIL owns the board
+static int
+check_idle(AVRoObject *self)
+{
+    if (self->running) {
+        PyErr_SetString(PyExc_RuntimeError, "AVR is running on another thread");
+        return -1;
+    }
+    return 0;
+}
 
-    // set the program memory to zero
-    memset(&self->program_memory, 0, 2*PROGRAM_MEMORY_SIZE);
+// host writes the log has no kind for, replay could not reproduce them
+static int
+check_unrecorded(AVRoObject *self)
+{
+    if (check_idle(self) < 0)
+        return -1;
+    if (self->core.record != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot change the state outside the logged inputs while recording");
+        return -1;
+    }
+    return 0;
+}
 
-    // set program_counter to zero
-    self->program_counter = 0;
-    return self;
+// history, record/replay and the engines running on copies of the state don't see an io hook,
+// the peripheral behind it is outside the state they save and compare
+static int
+check_unhooked(AVRoObject *self)
+{
+    if (self->core.io_hook.mask != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "not available while an io hook is set");
+        return -1;
+    }
+    return 0;
 }
 
-/* AVRo methods */
 // deallocate memory
 static void
 AVRo_dealloc(AVRoObject *self)
 {
     Py_XDECREF(self->x_attr);
+    if (self->coverage.obj != NULL)
+        PyBuffer_Release(&self->coverage);
+    avr_log_free(&self->record);
+    avr_history_stop(&self->core);
+    avr_detach_flash(&self->core);
+    avr_detach_eeprom(&self->core);
+    if (self->block.obj != NULL)
+        PyBuffer_Release(&self->block);
     PyObject_Free(self);
 }
 
+/* Argument conversion for the METH_FASTCALL accessors */
+
+// convert an int argument to an index below size, raises IndexError otherwise
+static int
+index_from_arg(PyObject *arg, unsigned long size, unsigned long *index)
+{
+    unsigned long value = PyLong_AsUnsignedLong(arg);
+    if (value == (unsigned long)-1 && PyErr_Occurred()) {
+        if (PyErr_ExceptionMatches(PyExc_OverflowError)) {
+            PyErr_Clear();
+            value = size;
+        } else {
+            return -1;
+        }
+    }
+    if (value >= size) {
+        PyErr_SetString(PyExc_IndexError, "index out of range");
+        return -1;
+    }
+    *index = value;
+    return 0;
+}
+
+// convert an int argument to a value no larger than max, raises OverflowError otherwise
+static int
+value_from_arg(PyObject *arg, unsigned long max, unsigned long *value)
+{
+    *value = PyLong_AsUnsignedLong(arg);
+    if (*value == (unsigned long)-1 && PyErr_Occurred())
+        return -1;
+    if (*value > max) {
+        PyErr_SetString(PyExc_OverflowError, "value out of range");
+        return -1;
+    }
+    return 0;
+}
+
+// sort positional and keyword arguments of a METH_FASTCALL | METH_KEYWORDS call into slots
+static int
+fastcall_args(const char *name, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames,
+              const char *const *kwlist, Py_ssize_t count, PyObject **slots)
+{
+    if (nargs > count) {
+        PyErr_Format(PyExc_TypeError, "%s() takes %zd arguments (%zd given)", name, count, nargs);
+        return -1;
+    }
+    for (Py_ssize_t i = 0; i < count; i++)
+        slots[i] = i < nargs ? args[i] : NULL;
+
+    Py_ssize_t nkwargs = kwnames == NULL ? 0 : PyTuple_GET_SIZE(kwnames);
+    for (Py_ssize_t k = 0; k < nkwargs; k++) {
+        PyObject *keyword = PyTuple_GET_ITEM(kwnames, k);
+        Py_ssize_t i = 0;
+        while (i < count && PyUnicode_CompareWithASCIIString(keyword, kwlist[i]) != 0)
+            i++;
+        if (i == count) {
+            PyErr_Format(PyExc_TypeError, "%s() got an unexpected keyword argument '%U'", name, keyword);
+            return -1;
+        }
+        if (slots[i] != NULL) {
+            PyErr_Format(PyExc_TypeError, "%s() got multiple values for argument '%s'", name, kwlist[i]);
+            return -1;
+        }
+        slots[i] = args[nargs + k];
+    }
+
+    for (Py_ssize_t i = 0; i < count; i++) {
+        if (slots[i] == NULL) {
+            PyErr_Format(PyExc_TypeError, "%s() missing required argument '%s'", name, kwlist[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static PyObject *
+AVRo_get_sreg(AVRoObject *self, PyObject *unused)
+{
+    return PyLong_FromLong(self->core.state->sreg);
+}
+
+static PyObject *
+AVRo_set_sreg(AVRoObject *self, PyObject *arg)
+{
+    unsigned long new_sreg;
+    if (check_idle(self) < 0 || value_from_arg(arg, 255, &new_sreg) < 0)
+        return NULL;
+
+    avr_input_sreg(&self->core, (uint8_t) new_sreg);
+
+    return PyLong_FromLong(self->core.state->sreg);
+}
+
+static PyObject *
+AVRo_get_register(AVRoObject *self, PyObject *arg)
+{
+    unsigned long index;
+    if (index_from_arg(arg, REGISTER_SIZE, &index) < 0)
+        return NULL;
+    return PyLong_FromLong(self->core.state->registers[index]);
+}
+
+static PyObject *
+AVRo_set_register(AVRoObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const kwlist[] = {"index", "new_value"};
+    PyObject *slots[2];
+    unsigned long index, new_value;
+
+    if (check_idle(self) < 0
+            || fastcall_args("set_register", args, nargs, kwnames, kwlist, 2, slots) < 0
+            || index_from_arg(slots[0], REGISTER_SIZE, &index) < 0
+            || value_from_arg(slots[1], 255, &new_value) < 0)
+        return NULL;
+
+    avr_input_register(&self->core, (uint8_t) index, (uint8_t) new_value);
+    return PyLong_FromLong(self->core.state->registers[index]);
+}
+
+static PyObject *
+AVRo_get_registers(AVRoObject *self, PyObject *unused)
+{
+    return PyBytes_FromStringAndSize((const char *)self->core.state->registers, REGISTER_SIZE);
+}
+
+static PyObject *
+AVRo_set_registers(AVRoObject *self, PyObject *args)
+{
+    Py_buffer data;
+    if (check_idle(self) < 0 || !PyArg_ParseTuple(args, "y*", &data))
+        return NULL;
+    if (data.len > REGISTER_SIZE) {
+        PyBuffer_Release(&data);
+        PyErr_SetString(PyExc_ValueError, "more values than registers");
+        return NULL;
+    }
+
+    // r0 upwards, registers past the data are left alone
+    for (Py_ssize_t i = 0; i < data.len; i++)
+        avr_input_register(&self->core, (uint8_t) i, ((const uint8_t *)data.buf)[i]);
+    PyBuffer_Release(&data);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_get_program_counter(AVRoObject *self, PyObject *unused)
+{
+    return PyLong_FromLong(self->core.state->program_counter);
+}
+
+static PyObject *
+AVRo_set_program_memory(AVRoObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char *const kwlist[] = {"instruction", "index"};
+    PyObject *slots[2];
+    unsigned long instruction, index;
+
+    if (check_unrecorded(self) < 0
+            || fastcall_args("set_program_memory", args, nargs, kwnames, kwlist, 2, slots) < 0
+            || value_from_arg(slots[0], 65535, &instruction) < 0
+            || index_from_arg(slots[1], PROGRAM_MEMORY_SIZE, &index) < 0)
+        return NULL;
+
+    self->core.state->program_memory[index] = (uint16_t) instruction;
+    avr_history_mark(&self->core);
+    return PyLong_FromLong(self->core.state->program_memory[index]);
+}
+
+static PyObject *
+AVRo_set_program_memory_block(AVRoObject *self, PyObject *args)
+{
+    Py_ssize_t offset;
+    Py_buffer data;
+
+    if (check_unrecorded(self) < 0 || !PyArg_ParseTuple(args, "ny*", &offset, &data))
+        return NULL;
+
+    // flash images are little endian words
+    Py_ssize_t words = data.len / 2;
+    if (data.len % 2) {
+        PyErr_SetString(PyExc_ValueError, "data must hold whole 16 bit words");
+    } else if (offset < 0 || offset > PROGRAM_MEMORY_SIZE || words > PROGRAM_MEMORY_SIZE - offset) {
+        PyErr_SetString(PyExc_IndexError, "block does not fit into the program memory");
+    } else {
+        const uint8_t *bytes = data.buf;
+        for (Py_ssize_t i = 0; i < words; i++)
+            self->core.state->program_memory[offset + i] = bytes[2 * i] | (bytes[2 * i + 1] << 8);
+        avr_history_mark(&self->core);
+    }
+    PyBuffer_Release(&data);
+
+    if (PyErr_Occurred())
+        return NULL;
+    return PyLong_FromSsize_t(words);
+}
+
+static PyObject *
+AVRo_get_program_memory(AVRoObject *self, PyObject *arg)
+{
+    unsigned long index;
+    if (index_from_arg(arg, PROGRAM_MEMORY_SIZE, &index) < 0)
+        return NULL;
+    return PyLong_FromLong(self->core.state->program_memory[index]);
+}
+
+static PyObject *
+AVRo_get_program_memory_size(AVRoObject *self, PyObject *args)
+{
+    return Py_BuildValue("k",PROGRAM_MEMORY_SIZE);
+}
+
+static PyObject *
+AVRo_get_sram_size(AVRoObject *self, PyObject *args)
+{
+    return Py_BuildValue("k",SRAM_SIZE);
+}
+
+
+static PyObject *
+AVRo_get_io_register(AVRoObject *self, PyObject *arg)
+{
+    unsigned long index;
+    if (index_from_arg(arg, IO_REGISTER_SIZE, &index) < 0)
+        return NULL;
+    return PyLong_FromLong(self->core.state->io_registers[index]);
+}
+
+static PyObject *
+AVRo_set_io_register(AVRoObject *self, PyObject *const *args, Py_ssize_t nargs)
+{
+    unsigned long index, new_value;
+
+    if (nargs != 2) {
+        PyErr_Format(PyExc_TypeError, "set_io_register() takes exactly 2 arguments (%zd given)", nargs);
+        return NULL;
+    }
+    if (check_idle(self) < 0
+            || index_from_arg(args[0], IO_REGISTER_SIZE, &index) < 0
+            || value_from_arg(args[1], 255, &new_value) < 0)
+        return NULL;
+
+    // raw store without side effects
+    avr_input_io_register(&self->core, (uint8_t) index, (uint8_t) new_value);
+    return PyLong_FromLong(self->core.state->io_registers[index]);
+}
+
+static PyObject *
+AVRo_get_cycles(AVRoObject *self, PyObject *unused)
+{
+    return PyLong_FromUnsignedLongLong(self->core.state->cycles);
+}
+
+static PyObject *
+AVRo_get_instructions(AVRoObject *self, PyObject *unused)
+{
+    return PyLong_FromUnsignedLongLong(self->core.state->instructions);
+}
+
+static PyObject *
+AVRo_load_image(AVRoObject *self, PyObject *args)
+{
+    PyObject *path;
+    if (check_unrecorded(self) < 0 || !PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &path))
+        return NULL;
+
+    int words = avr_load_image(self->core.state, PyBytes_AS_STRING(path));
+    avr_history_mark(&self->core);
+    if (words < 0) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        Py_DECREF(path);
+        return NULL;
+    }
+    Py_DECREF(path);
+    return PyLong_FromLong(words);
+}
+
+// shared by attach_flash and attach_eeprom, the file is read into the state right away
+static PyObject *
+attach_file(AVRoObject *self, PyObject *args, PyObject *keywds, int default_mode,
+            int (*attach)(avr_core *, const char *, int))
+{
+    PyObject *path;
+    int mode = default_mode;
+
+    static char *kwlist[] = {"path", "mode", NULL};
+
+    if (check_unrecorded(self) < 0
+            || !PyArg_ParseTupleAndKeywords(args, keywds, "O&|i", kwlist, PyUnicode_FSConverter, &path, &mode))
+        return NULL;
+
+    int count = attach(&self->core, PyBytes_AS_STRING(path), mode);
+    if (count < 0) {
+        if (errno == EINVAL)
+            PyErr_Format(PyExc_ValueError, "cannot map %R with mode %d", path, mode);
+        else
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        Py_DECREF(path);
+        return NULL;
+    }
+    avr_history_mark(&self->core);
+    Py_DECREF(path);
+    return PyLong_FromLong(count);
+}
+
+static PyObject *
+AVRo_attach_flash(AVRoObject *self, PyObject *args, PyObject *keywds)
+{
+    return attach_file(self, args, keywds, AVR_MAP_READ, avr_attach_flash);
+}
+
+static PyObject *
+AVRo_attach_eeprom(AVRoObject *self, PyObject *args, PyObject *keywds)
+{
+    return attach_file(self, args, keywds, AVR_MAP_WRITE, avr_attach_eeprom);
+}
+
+static PyObject *
+AVRo_detach_flash(AVRoObject *self, PyObject *unused)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    avr_detach_flash(&self->core);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_detach_eeprom(AVRoObject *self, PyObject *unused)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    avr_detach_eeprom(&self->core);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_get_eeprom(AVRoObject *self, PyObject *unused)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    return PyBytes_FromStringAndSize((const char *)self->core.state->eeprom.data, EEPROM_SIZE);
+}
+
+static PyObject *
+AVRo_set_eeprom(AVRoObject *self, PyObject *args)
+{
+    Py_ssize_t offset = 0;
+    Py_buffer data;
+
+    if (check_unrecorded(self) < 0 || !PyArg_ParseTuple(args, "y*|n", &data, &offset))
+        return NULL;
+
+    if (offset < 0 || offset > EEPROM_SIZE || data.len > EEPROM_SIZE - offset) {
+        PyErr_SetString(PyExc_IndexError, "block does not fit into the eeprom");
+    } else {
+        // written through to an attached file like the writes of the firmware
+        const uint8_t *bytes = data.buf;
+        for (Py_ssize_t i = 0; i < data.len; i++)
+            avr_eeprom_store(&self->core, (uint16_t)(offset + i), bytes[i]);
+        avr_history_mark(&self->core);
+    }
+    Py_ssize_t length = data.len;
+    PyBuffer_Release(&data);
+
+    if (PyErr_Occurred())
+        return NULL;
+    return PyLong_FromSsize_t(length);
+}
+
 static PyObject *
-AVRo_get_sreg(AVRoObject *self, PyObject *args)
+AVRo_uart_write(AVRoObject *self, PyObject *args)
 {
-    return Py_BuildValue("H", self->sreg);
+    if (check_idle(self) < 0)
+        return NULL;
+    Py_buffer data;
+    if (!PyArg_ParseTuple(args, "y*", &data))
+        return NULL;
+
+    uint32_t length = data.len > UINT32_MAX ? UINT32_MAX : (uint32_t)data.len;
+    uint32_t accepted = avr_input_uart(&self->core, data.buf, length);
+    PyBuffer_Release(&data);
+    return PyLong_FromUnsignedLong(accepted);
 }
 
 static PyObject *
-AVRo_set_sreg(AVRoObject *self, PyObject *args)
+AVRo_uart_read(AVRoObject *self, PyObject *args)
 {
-    uint8_t new_sreg;
-    // parse the argument to a uint8_t
-    if (!PyArg_ParseTuple(args, "b", &new_sreg))
+    if (check_idle(self) < 0)
+        return NULL;
+    Py_ssize_t size = -1;
+    if (!PyArg_ParseTuple(args, "|n", &size))
+        return NULL;
+
+    uint32_t pending = avr_uart_tx_pending(self->core.state);
+    if (size < 0 || (size_t)size > pending)
+        size = pending;
+
+    PyObject *result = PyBytes_FromStringAndSize(NULL, size);
+    if (result == NULL)
+        return NULL;
+    avr_uart_tx_pop(self->core.state, (uint8_t *)PyBytes_AS_STRING(result), (uint32_t)size);
+    return result;
+}
+
+static PyObject *
+AVRo_uart_readinto(AVRoObject *self, PyObject *args)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    Py_buffer buffer;
+    if (!PyArg_ParseTuple(args, "w*", &buffer))
+        return NULL;
+
+    uint32_t length = buffer.len > UINT32_MAX ? UINT32_MAX : (uint32_t)buffer.len;
+    uint32_t copied = avr_uart_tx_pop(self->core.state, buffer.buf, length);
+    PyBuffer_Release(&buffer);
+    return PyLong_FromUnsignedLong(copied);
+}
+
+static PyObject *
+AVRo_uart_set_tx_fd(AVRoObject *self, PyObject *args)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    int fd;
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+
+    self->core.uart_tx_fd = fd < 0 ? -1 : fd;
+    if (avr_uart_flush(&self->core) < 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_uart_get_stats(AVRoObject *self, PyObject *args)
+{
+    return Py_BuildValue("{s:I,s:I,s:K}",
+                         "rx_pending", (unsigned int)avr_uart_rx_pending(self->core.state),
+                         "tx_pending", (unsigned int)avr_uart_tx_pending(self->core.state),
+                         "tx_overruns", (unsigned long long)self->core.state->uart.tx_overruns);
+}
+
+// flush streamed uart output after a run, raises on failure
+static int
+finish_run(AVRoObject *self)
+{
+    if (avr_uart_flush(&self->core) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+AVRo_run_next_instruction(AVRoObject *self, PyObject *unused)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    avr_run_instruction(&self->core);
+    if (finish_run(self) < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+AVRo_run_until_break(AVRoObject *self, PyObject *args)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    avr_run(&self->core, AVR_UNLIMITED, AVR_UNLIMITED);
+
+    if (finish_run(self) < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_run_instructions(AVRoObject *self, PyObject *args)
+{
+    unsigned long long count;
+
+    if (check_idle(self) < 0 || !PyArg_ParseTuple(args, "K", &count))
+        return NULL;
+
+    // stops early at BREAK like run_until_break
+    avr_run(&self->core, AVR_UNLIMITED, count);
+
+    if (finish_run(self) < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+
+/* Fuzzing */
+
+static PyObject *
+AVRo_set_coverage_map(AVRoObject *self, PyObject *arg)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+
+    Py_buffer map = {0};
+    if (arg != Py_None) {
+        if (PyObject_GetBuffer(arg, &map, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0)
+            return NULL;
+        if (map.len != AVR_COVERAGE_MAP_SIZE) {
+            PyBuffer_Release(&map);
+            PyErr_Format(PyExc_ValueError, "coverage map must be %d bytes", AVR_COVERAGE_MAP_SIZE);
+            return NULL;
+        }
+    }
+
+    if (self->coverage.obj != NULL)
+        PyBuffer_Release(&self->coverage);
+    self->coverage = map;
+    self->core.coverage_map = map.obj != NULL ? map.buf : NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_take_snapshot(AVRoObject *self, PyObject *unused)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    return PyBytes_FromStringAndSize((const char *)self->core.state, sizeof(avr_state));
+}
+
+// copy a snapshot into the machine state, rejects buffers that don't come from take_snapshot
+static int
+restore_from_buffer(AVRoObject *self, Py_buffer *snapshot)
+{
+    const avr_state *state = snapshot->buf;
+    if (check_unrecorded(self) < 0)
+        return -1;
+    if (snapshot->len != sizeof(avr_state) || avr_state_check(state) < 0) {
+        PyErr_SetString(PyExc_ValueError, "not a snapshot of this emulator");
+        return -1;
+    }
+    memcpy(self->core.state, state, sizeof(avr_state));
+    avr_history_mark(&self->core);
+    return 0;
+}
+
+static PyObject *
+AVRo_restore_snapshot(AVRoObject *self, PyObject *args)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    Py_buffer snapshot;
+    if (!PyArg_ParseTuple(args, "y*", &snapshot))
+        return NULL;
+
+    int rv = restore_from_buffer(self, &snapshot);
+    PyBuffer_Release(&snapshot);
+    if (rv < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_fuzz_run(AVRoObject *self, PyObject *args, PyObject *keywds)
+{
+    Py_buffer snapshot, input;
+    unsigned long long max_cycles = AVR_UNLIMITED;
+    PyObject *address_arg = Py_None;
+    long address = AVR_INPUT_UART;
+
+    static char *kwlist[] = {"snapshot", "data", "max_cycles", "address", NULL};
+
+    if (check_idle(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "y*y*|KO", kwlist, &snapshot, &input, &max_cycles, &address_arg))
+        return NULL;
+
+    if (address_arg != Py_None) {
+        address = PyLong_AsLong(address_arg);
+        if (address == -1 && PyErr_Occurred())
+            goto fail;
+        if (address < 0 || address >= DATA_SIZE) {
+            PyErr_SetString(PyExc_IndexError, "address out of range");
+            goto fail;
+        }
+    }
+    if (restore_from_buffer(self, &snapshot) < 0)
+        goto fail;
+
+    int status;
+    self->running = 1;
+    Py_BEGIN_ALLOW_THREADS
+    status = avr_fuzz_run(&self->core, self->core.state, input.buf, input.len, (int32_t)address, max_cycles);
+    Py_END_ALLOW_THREADS
+    self->running = 0;
+
+    PyBuffer_Release(&snapshot);
+    PyBuffer_Release(&input);
+    if (finish_run(self) < 0)
+        return NULL;
+    return PyLong_FromLong(status);
+
+ fail:
+    PyBuffer_Release(&snapshot);
+    PyBuffer_Release(&input);
+    return NULL;
+}
+
+
+/* Record/replay */
+
+static PyObject *
+AVRo_record_start(AVRoObject *self, PyObject *unused)
+{
+    if (check_idle(self) < 0 || check_unhooked(self) < 0)
+        return NULL;
+
+    // restarting discards the previous log
+    avr_log_free(&self->record);
+    self->core.record = NULL;
+    if (avr_log_start(&self->record, self->core.state->cycles) < 0)
+        return PyErr_NoMemory();
+    self->core.record = &self->record;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_record_stop(AVRoObject *self, PyObject *unused)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    if (self->core.record == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "not recording");
+        return NULL;
+    }
+
+    avr_log_stop(&self->record, self->core.state->cycles);
+    self->core.record = NULL;
+
+    PyObject *log = NULL;
+    if (self->record.failed)
+        PyErr_NoMemory();
+    else
+        log = PyBytes_FromStringAndSize((const char *)self->record.data, self->record.length);
+    avr_log_free(&self->record);
+    return log;
+}
+
+static PyObject *
+AVRo_replay(AVRoObject *self, PyObject *args, PyObject *keywds)
+{
+    Py_buffer log;
+    unsigned long long max_cycles = AVR_UNLIMITED;
+    int rv;
+
+    static char *kwlist[] = {"log", "max_cycles", NULL};
+
+    if (check_idle(self) < 0 || check_unhooked(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "y*|K", kwlist, &log, &max_cycles))
+        return NULL;
+
+    self->running = 1;
+    Py_BEGIN_ALLOW_THREADS
+    rv = avr_replay(&self->core, log.buf, log.len, max_cycles);
+    Py_END_ALLOW_THREADS
+    self->running = 0;
+    PyBuffer_Release(&log);
+
+    if (rv < 0) {
+        PyErr_Format(PyExc_ValueError, "replay diverged from the log at cycle %llu",
+                     (unsigned long long)self->core.state->cycles);
+        return NULL;
+    }
+    if (finish_run(self) < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+
+/* Reverse execution */
+
+// raise for a failed history query
+static PyObject *
+history_error(void)
+{
+    if (errno == ENOMEM)
+        return PyErr_NoMemory();
+    if (errno == ERANGE)
+        PyErr_SetString(PyExc_ValueError, "target is outside the recorded history");
+    else
+        PyErr_SetString(PyExc_RuntimeError, "history is not enabled");
+    return NULL;
+}
+
+// queries move the state, a log being recorded could not follow
+static int
+check_travel(AVRoObject *self)
+{
+    if (check_idle(self) < 0)
+        return -1;
+    if (self->core.record != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot go back while recording");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+AVRo_history_start(AVRoObject *self, PyObject *args, PyObject *keywds)
+{
+    unsigned long long interval = HISTORY_INTERVAL;
+    Py_ssize_t limit = 0;
+
+    static char *kwlist[] = {"interval", "limit", NULL};
+
+    if (check_idle(self) < 0 || check_unhooked(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|Kn", kwlist, &interval, &limit))
+        return NULL;
+    if (interval == 0 || limit < 0 || limit == 1) {
+        PyErr_SetString(PyExc_ValueError, "interval must be positive and limit 0 or at least 2");
+        return NULL;
+    }
+
+    avr_history_stop(&self->core);
+    if (avr_history_start(&self->core, &self->history, interval, (size_t)limit) < 0)
+        return PyErr_NoMemory();
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_history_stop(AVRoObject *self, PyObject *unused)
+{
+    if (check_idle(self) < 0)
+        return NULL;
+    avr_history_stop(&self->core);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+AVRo_history_get_stats(AVRoObject *self, PyObject *unused)
+{
+    avr_history *history = self->core.history;
+    if (history == NULL)
         Py_RETURN_NONE;
 
-    self->sreg = (uint8_t) new_sreg;
+    return Py_BuildValue("{s:n,s:n,s:K,s:K}",
+                         "checkpoints", (Py_ssize_t)history->count,
+                         "bytes", (Py_ssize_t)(history->count * sizeof(avr_state)),
+                         "interval", (unsigned long long)history->interval,
+                         "oldest_instruction",
+                         (unsigned long long)(history->count ? history->checkpoints[0]->instructions : 0));
+}
+
+static PyObject *
+AVRo_step_back(AVRoObject *self, PyObject *args)
+{
+    unsigned long long count = 1;
+    int rv;
+
+    if (check_travel(self) < 0 || !PyArg_ParseTuple(args, "|K", &count))
+        return NULL;
+    if (count > self->core.state->instructions) {
+        PyErr_SetString(PyExc_ValueError, "target is outside the recorded history");
+        return NULL;
+    }
+
+    self->running = 1;
+    Py_BEGIN_ALLOW_THREADS
+    rv = avr_history_seek(&self->core, self->core.state->instructions - count);
+    Py_END_ALLOW_THREADS
+    self->running = 0;
 
-    return Py_BuildValue("H",self->sreg);
+    if (rv < 0)
+        return history_error();
+    Py_RETURN_NONE;
 }
 
 static PyObject *
-AVRo_get_register(AVRoObject *self, PyObject *args)
+AVRo_run_back_to(AVRoObject *self, PyObject *args, PyObject *keywds)
 {
-    int64_t index;
-    if (!PyArg_ParseTuple(args, "k", &index) )//|| index < 0 || index >= REGISTER_SIZE)
-        //todo
-         Py_RETURN_NONE;
-    return Py_BuildValue("k",self->registers[index]);
+    PyObject *pc_arg = Py_None, *cycle_arg = Py_None;
+    unsigned long target;
+    int rv;
+
+    static char *kwlist[] = {"pc", "cycle", NULL};
+
+    if (check_travel(self) < 0 || !PyArg_ParseTupleAndKeywords(args, keywds, "|OO", kwlist, &pc_arg, &cycle_arg))
+        return NULL;
+    if ((pc_arg == Py_None) == (cycle_arg == Py_None)) {
+        PyErr_SetString(PyExc_TypeError, "run_back_to() takes either pc or cycle");
+        return NULL;
+    }
+
+    if (pc_arg != Py_None) {
+        if (index_from_arg(pc_arg, PROGRAM_MEMORY_SIZE, &target) < 0)
+            return NULL;
+        self->running = 1;
+        Py_BEGIN_ALLOW_THREADS
+        rv = avr_history_back_to_pc(&self->core, (uint16_t)target);
+        Py_END_ALLOW_THREADS
+        self->running = 0;
+    } else {
+        unsigned long long cycle = PyLong_AsUnsignedLongLong(cycle_arg);
+        if (cycle == (unsigned long long)-1 && PyErr_Occurred())
+            return NULL;
+        self->running = 1;
+        Py_BEGIN_ALLOW_THREADS
+        rv = avr_history_back_to_cycle(&self->core, cycle) < 0 ? -1 : 1;
+        Py_END_ALLOW_THREADS
+        self->running = 0;
+    }
+
+    if (rv < 0)
+        return history_error();
+    return PyBool_FromLong(rv);
 }
 
 static PyObject *
-AVRo_set_register(AVRoObject *self, PyObject *args, PyObject *keywds){
-    uint8_t new_value;
-    uint64_t index;
+AVRo_last_write(AVRoObject *self, PyObject *arg)
+{
+    unsigned long address;
+    avr_history_write write;
+    int rv;
+
+    if (check_idle(self) < 0 || index_from_arg(arg, DATA_SIZE, &address) < 0)
+        return NULL;
+
+    self->running = 1;
+    Py_BEGIN_ALLOW_THREADS
+    rv = avr_history_last_write(&self->core, (uint16_t)address, &write);
+    Py_END_ALLOW_THREADS
+    self->running = 0;
+
+    if (rv < 0)
+        return history_error();
+    if (rv == 0)
+        Py_RETURN_NONE;
+    return Py_BuildValue("{s:K,s:K,s:i}",
+                         "instructions", (unsigned long long)write.instructions,
+                         "cycles", (unsigned long long)write.cycles,
+                         "program_counter", write.program_counter);
+}
+
 
-    static char *kwlist[] = {"index", "new_value", NULL};
+/* Fault injection */
 
-    if (!PyArg_ParseTupleAndKeywords(args, keywds, "kb", kwlist, &index, &new_value) || index < 0 || index >= REGISTER_SIZE || new_value>255 || new_value < 0) {
-        //todo
-         Py_RETURN_NONE;
+// convert a (cycle, target, address, mask) tuple, index numbers it in error messages
+static int
+fault_from_arg(PyObject *item, Py_ssize_t i, avr_fault *fault)
+{
+    PyObject *address_arg, *mask_arg;
+    unsigned long long cycle;
+    unsigned char target;
+    unsigned long address, mask;
+
+    if (!PyArg_ParseTuple(item, "KbOO;fault must be (cycle, target, address, mask)",
+                          &cycle, &target, &address_arg, &mask_arg)
+            || value_from_arg(address_arg, 0xFFFF, &address) < 0
+            || value_from_arg(mask_arg, 0xFFFF, &mask) < 0)
+        return -1;
+    *fault = (avr_fault){cycle, target, (uint16_t)address, (uint16_t)mask};
+
+    unsigned long size = target == AVR_FAULT_REGISTER ? REGISTER_SIZE
+                       : target == AVR_FAULT_SRAM ? SRAM_SIZE
+                       : target == AVR_FAULT_FLASH ? PROGRAM_MEMORY_SIZE : 1;
+    if (target > AVR_FAULT_FLASH) {
+        PyErr_Format(PyExc_ValueError, "fault %zd: unknown target %d", i, target);
+        return -1;
+    }
+    if (target != AVR_FAULT_SREG && address >= size) {
+        PyErr_Format(PyExc_IndexError, "fault %zd: address out of range", i);
+        return -1;
+    }
+    if (target != AVR_FAULT_FLASH && mask > 0xFF) {
+        PyErr_Format(PyExc_ValueError, "fault %zd: mask wider than 8 bits", i);
+        return -1;
+    }
+    return 0;
+}
+
+// convert a sequence of fault tuples, returns NULL with an exception set
+static avr_fault *
+faults_from_arg(PyObject *arg, Py_ssize_t *count)
+{
+    PyObject *sequence = PySequence_Fast(arg, "faults must be a sequence");
+    if (sequence == NULL)
+        return NULL;
+
+    *count = PySequence_Fast_GET_SIZE(sequence);
+    avr_fault *faults = PyMem_New(avr_fault, *count ? *count : 1);
+    if (faults == NULL) {
+        Py_DECREF(sequence);
+        PyErr_NoMemory();
+        return NULL;
     }
 
-    self->registers[index] = (uint8_t) new_value;
-    return Py_BuildValue("k", self->registers[index]);
+    for (Py_ssize_t i = 0; i < *count; i++) {
+        if (fault_from_arg(PySequence_Fast_GET_ITEM(sequence, i), i, &faults[i]) < 0)
+            goto fail;
+    }
+    Py_DECREF(sequence);
+    return faults;
 
+ fail:
+    PyMem_Free(faults);
+    Py_DECREF(sequence);
+    return NULL;
 }
 
 static PyObject *
-AVRo_get_program_counter(AVRoObject *self, PyObject *args)
+AVRo_fault_campaign(AVRoObject *self, PyObject *args, PyObject *keywds)
 {
-    return Py_BuildValue("k", self->program_counter);
-}
+    PyObject *faults_arg;
+    unsigned long long max_cycles;
+    Py_ssize_t code_words = PROGRAM_MEMORY_SIZE;
+    int threads = 0;
+    Py_ssize_t count;
+    int rv;
 
-static PyObject *
-AVRo_set_program_memory(AVRoObject *self, PyObject *args, PyObject *keywds){
-    uint64_t index = 0;
-    uint16_t instruction = 0;
+    static char *kwlist[] = {"faults", "max_cycles", "code_words", "threads", NULL};
+
+    if (check_idle(self) < 0 || check_unhooked(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OK|ni", kwlist, &faults_arg, &max_cycles, &code_words, &threads))
+        return NULL;
+    if (code_words < 1 || code_words > PROGRAM_MEMORY_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "code_words out of range");
+        return NULL;
+    }
 
-    static char *kwlist[] = {"instruction", "index", NULL};
+    avr_fault *faults = faults_from_arg(faults_arg, &count);
+    if (faults == NULL)
+        return NULL;
+    PyObject *outcomes = PyBytes_FromStringAndSize(NULL, count);
+    if (outcomes == NULL) {
+        PyMem_Free(faults);
+        return NULL;
+    }
 
-    if (!PyArg_ParseTupleAndKeywords(args, keywds, "kk", kwlist, &instruction, &index) || index < 0 || index >= PROGRAM_MEMORY_SIZE || instruction>65535 || instruction < 0)
-        //todo
-         Py_RETURN_NONE;
-    //printf("SREG as int %s\n", program);
-    self->program_memory[index] = instruction;
-    return Py_BuildValue("k",self->program_memory[index]);
+    // the workers copy the state, the board itself stays untouched
+    self->running = 1;
+    Py_BEGIN_ALLOW_THREADS
+    rv = avr_fault_campaign(self->core.state, faults, count, (uint16_t)code_words, max_cycles, threads,
+                            (uint8_t *)PyBytes_AS_STRING(outcomes));
+    Py_END_ALLOW_THREADS
+    self->running = 0;
+    PyMem_Free(faults);
+
+    if (rv < 0) {
+        Py_DECREF(outcomes);
+        if (errno == ENOMEM)
+            return PyErr_NoMemory();
+        PyErr_SetString(PyExc_ValueError, "the golden run does not reach BREAK within max_cycles");
+        return NULL;
+    }
+    return outcomes;
 }
 
+
+/* Differential validation */
+
+// (field, index, reference, backend) tuples, index is None for scalars
 static PyObject *
-AVRo_get_program_memory(AVRoObject *self, PyObject *args)
+state_diff(const avr_state *reference, const avr_state *backend)
 {
-    int64_t index;
-    if (!PyArg_ParseTuple(args, "k", &index) || index < 0 || index >= PROGRAM_MEMORY_SIZE)
-        //todo
-         Py_RETURN_NONE;
-    return Py_BuildValue("k",self->program_memory[index]);
+    size_t count = avr_state_diff_list(reference, backend, NULL, 0);
+    avr_state_diff *diffs = PyMem_Calloc(count ? count : 1, sizeof(avr_state_diff));
+    if (diffs == NULL)
+        return PyErr_NoMemory();
+    avr_state_diff_list(reference, backend, diffs, count);
+
+    PyObject *list = PyList_New(count);
+    for (size_t i = 0; list != NULL && i < count; i++) {
+        PyObject *item = diffs[i].index < 0
+            ? Py_BuildValue("(sOKK)", diffs[i].field, Py_None, diffs[i].reference, diffs[i].backend)
+            : Py_BuildValue("(siKK)", diffs[i].field, diffs[i].index, diffs[i].reference, diffs[i].backend);
+        if (item == NULL)
+            Py_CLEAR(list);
+        else
+            PyList_SET_ITEM(list, i, item);
+    }
+    PyMem_Free(diffs);
+    return list;
 }
 
+// run avr_validate on copies of the board state and build the report
 static PyObject *
-AVRo_get_program_memory_size(AVRoObject *self, PyObject *args)
+validate_report(AVRoObject *self, uint64_t max_instructions, uint64_t block, avr_backend backend, void *context)
 {
-    return Py_BuildValue("k",PROGRAM_MEMORY_SIZE);
+    avr_divergence divergence;
+    int rv;
+
+    avr_state *reference = PyMem_Malloc(sizeof(avr_state));
+    avr_state *result = PyMem_Malloc(sizeof(avr_state));
+    if (reference == NULL || result == NULL) {
+        PyMem_Free(reference);
+        PyMem_Free(result);
+        return PyErr_NoMemory();
+    }
+
+    // both sides run on copies, the board itself stays untouched
+    self->running = 1;
+    Py_BEGIN_ALLOW_THREADS
+    rv = avr_validate(self->core.state, backend, context, max_instructions, block, reference, result,
+                      &divergence);
+    Py_END_ALLOW_THREADS
+    self->running = 0;
+
+    PyObject *report = NULL;
+    if (rv < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+    } else if (rv == 0) {
+        Py_INCREF(Py_None);
+        report = Py_None;
+    } else {
+        PyObject *diff = state_diff(reference, result);
+        if (diff != NULL)
+            report = Py_BuildValue("{sKsHsHsN}", "instructions", divergence.instructions,
+                                   "pc", divergence.program_counter, "instruction", divergence.instruction,
+                                   "diff", diff);
+    }
+    PyMem_Free(reference);
+    PyMem_Free(result);
+    return report;
 }
 
 static PyObject *
-AVRo_get_sram_size(AVRoObject *self, PyObject *args)
+AVRo_validate(AVRoObject *self, PyObject *args, PyObject *keywds)
 {
-    return Py_BuildValue("k",SRAM_SIZE);
-}
+    unsigned long long max_instructions;
+    unsigned long long block = VALIDATE_BLOCK;
 
+    static char *kwlist[] = {"max_instructions", "block", NULL};
 
-static int run_instruction(AVRoObject *self){
-    // Load instruction from program memory using the program counter
-    uint16_t instruction = self->program_memory[self->program_counter];
-
-    if (instruction == 0){
-        // NOP
-        #ifdef DEBUG
-        printf("NOP\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0001110000000000)){
-        // ADC
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t rr= self->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
-        uint8_t result = rd + rr + get_bit(self->sreg,0);
-
-        // Update SREG
-        uint8_t h = ( g_rd3 & g_rr3 ) | ( g_rr3 & (!g_r3) ) | ( (!g_r3) & g_rd3 );
-        uint8_t v = ( g_rd7 & g_rr7 & (!g_r7) ) | ((!g_rd7) & (!g_rr7) & g_r7);
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t c = ( g_rd7 & g_rr7) | (g_rr7 & (!g_r7)) | ( (!g_r7) & g_rd7 );
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11000000) | (h << 5) | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1) | c;
-        // Move result to storage
-        self->registers[(instruction & 0b0000000111110000) >> 4] = result;
-
-        #ifdef DEBUG
-        printf("ADC\n");
-        //printf("Rd i: %i\n", (instruction & 0b0000000111110000) >> 4);
-        //printf("Rr i: %i\n", (instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5));
-        //printf("Rd: %i\n",rd);
-        //printf("Rr: %i\n",rr);
-        //printf("Result: %i\n",result);
-        #endif
-
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0000110000000000)){
-        // ADD
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t rr= self->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
-        uint8_t result = rd + rr;
-
-        // Update SREG
-        uint8_t h = ( g_rd3 & g_rr3 ) | ( g_rr3 & (!g_r3) ) | ( (!g_r3) & g_rd3 );
-        uint8_t v = ( g_rd7 & g_rr7 & (!g_r7) ) | ((!g_rd7) & (!g_rr7) & g_r7);
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t c = ( g_rd7 & g_rr7) | (g_rr7 & (!g_r7)) | ( (!g_r7) & g_rd7 );
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11000000) | (h << 5) | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1) | c;
+    if (check_idle(self) < 0 || check_unhooked(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "K|K", kwlist, &max_instructions, &block))
+        return NULL;
+    if (block == 0) {
+        PyErr_SetString(PyExc_ValueError, "block must be positive");
+        return NULL;
+    }
+    return validate_report(self, max_instructions, block, avr_run_backend, NULL);
+}
 
+// validate with a known divergence in the fast engine, checks the validation itself in the tests
+static PyObject *
+AVRo_validate_injected(AVRoObject *self, PyObject *args)
+{
+    unsigned long long max_instructions;
+    unsigned long long block;
+    PyObject *fault_arg;
+    avr_injection injection;
 
-        // Move result to storage
-        self->registers[(instruction & 0b0000000111110000) >> 4] = result;
-
-        #ifdef DEBUG
-        printf("ADD\n");
-        #endif
+    if (check_idle(self) < 0 || check_unhooked(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTuple(args, "KKO", &max_instructions, &block, &fault_arg))
+        return NULL;
+    if (block == 0) {
+        PyErr_SetString(PyExc_ValueError, "block must be positive");
+        return NULL;
+    }
+    // the fault tuple counts instructions instead of cycles
+    if (fault_from_arg(fault_arg, 0, &injection.fault) < 0)
+        return NULL;
+    if (injection.fault.cycle == 0) {
+        PyErr_SetString(PyExc_ValueError, "a fault needs at least one instruction before it");
+        return NULL;
+    }
+    injection.instructions = self->core.state->instructions + injection.fault.cycle;
+    return validate_report(self, max_instructions, block, avr_run_injected, &injection);
+}
 
-    }else if(NOT_IMPLEMENTED){
-        // ADIW
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0010000000000000)){
-        // AND
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t rr= self->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
-        uint8_t result = rd & rr;
-
-        // Update SREG
-
-        uint8_t v = 0;
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11100001)  | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1);
-
-
-        self->registers[(instruction & 0b0000000111110000) >> 4] = result;
-
-        #ifdef DEBUG
-        printf("AND\n");
-        #endif
-
-    }else if(instr_check(instruction, 0b1111000000000000, 0b0111000000000000)){
-        // ANDI
-        uint8_t d = 16 + ((instruction & 0b0000000011110000) >> 4);
-        uint8_t rd = self->registers[d] ;
-        uint8_t k = (instruction & 0b0000000000001111) + ((instruction & 0b0000111100000000)>>4);
-        uint8_t result = rd & k;
-
-        // Update SREG
-        uint8_t v = 0;
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11100001)  | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1);
-
-        self->registers[d] = result;
-
-        #ifdef DEBUG
-        printf("ANDI\n");
-        #endif
-
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000101)){
-        // ASR
-        // Signed for arithmetic shift
-        uint8_t rd = self->registers[16 + ((instruction & 0b0000000111110000) >> 4)] ;
-        uint8_t result = rd >> 1;
-
-        // Update SREG
-        uint8_t c = get_bit(rd,0);
-        uint8_t z = result == 0;
-        uint8_t n = g_r7;
-        uint8_t v = n ^ c;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 011100000) | (s << 4)  | (v << 3)  | (n << 2)  | (z << 1) | c;
+/* Real-time pacing */
 
+static PyObject *
+AVRo_run_paced(AVRoObject *self, PyObject *args, PyObject *keywds)
+{
+    uint64_t cycles;
+    double frequency = 16e6;
+    uint64_t batch_cycles = 0;
+    uint64_t spin_ns = PACED_SPIN_NS;
+    avr_pacing_stats stats;
+    int rv;
 
-        self->registers[16 + ((instruction & 0b0000000111110000) >> 4)] = result;
+    static char *kwlist[] = {"cycles", "frequency", "batch_cycles", "spin_ns", NULL};
 
-        #ifdef DEBUG
-        printf("ASR\n");
-        #endif
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "K|dKK", kwlist, &cycles, &frequency, &batch_cycles, &spin_ns))
+        return NULL;
+    if (!(frequency > 0)) {
+        PyErr_SetString(PyExc_ValueError, "frequency must be positive");
+        return NULL;
+    }
+    if (check_idle(self) < 0)
+        return NULL;
 
-    }else if(instr_check(instruction, 0b1111111110001111, 0b1001010010001000)){
-        // BCLR
-        uint8_t position = (instruction & 0b0000000001110000) >> 4;
-        // todo
-        uint8_t test = 0;
+    self->running = 1;
+    Py_BEGIN_ALLOW_THREADS
+    rv = avr_run_paced(&self->core, cycles, frequency, batch_cycles, spin_ns, &stats);
+    Py_END_ALLOW_THREADS
+    self->running = 0;
+
+    if (rv < 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+
+    uint64_t on_time = stats.batches - stats.overruns;
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:L}",
+                         "cycles", (unsigned long long)stats.cycles,
+                         "batches", (unsigned long long)stats.batches,
+                         "overruns", (unsigned long long)stats.overruns,
+                         "max_overrun_ns", (unsigned long long)stats.max_overrun_ns,
+                         "mean_jitter_ns", (unsigned long long)(on_time ? stats.total_jitter_ns / on_time : 0),
+                         "max_jitter_ns", (unsigned long long)stats.max_jitter_ns,
+                         "elapsed_ns", (unsigned long long)stats.elapsed_ns,
+                         "drift_ns", (long long)stats.elapsed_ns - (long long)((double)stats.cycles * 1e9 / frequency));
+}
 
-        memcpy(&test,&self->sreg,1);
+/* Asynchronous execution */
 
-        printf("Sreg = %i\n",test);
-        self->sreg = ((uint8_t)self->sreg) & ~(1<<position);
+typedef struct {
+    AVRoObject  *board;         /* strong reference, keeps the board alive */
+    PyObject    *loop;
+    PyObject    *future;
+    uint64_t    end_cycle;      /* stop once the cycle counter reaches this */
+} async_job;
 
-        #ifdef DEBUG
-        printf("BCLR\n");
-        #endif
+// runs on the event loop thread, the future may have been cancelled meanwhile
+static PyObject *
+async_complete(PyObject *module, PyObject *args)
+{
+    PyObject *future, *value, *is_error;
+    if (!PyArg_ParseTuple(args, "OOO", &future, &value, &is_error))
+        return NULL;
 
-    }else if(instr_check(instruction, 0b1111111000001000, 0b1111100000000000)){
-        // BLD
-        uint8_t position = (instruction & 0b0000000000000111);
-        // todo
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4];
+    PyObject *done = PyObject_CallMethod(future, "done", NULL);
+    if (done == NULL)
+        return NULL;
+    int already_done = PyObject_IsTrue(done);
+    Py_DECREF(done);
+    if (already_done)
+        Py_RETURN_NONE;
 
-        self->registers[(instruction & 0b0000000111110000) >> 4] = ( (~(1 << position )) & rd) | ((get_bit(self->sreg, 6))<< position);
+    return PyObject_CallMethod(future, PyObject_IsTrue(is_error) ? "set_exception" : "set_result", "O", value);
+}
 
-        #ifdef DEBUG
-        printf("BLD\n");
-        #endif
+static PyMethodDef async_complete_def = {
+    "_async_complete", async_complete, METH_VARARGS, NULL
+};
 
-    }else if(instr_check(instruction, 0b1111110000000000, 0b1111010000000000)){
-        // BRBC
-        uint8_t position = (instruction & 0b0000000000000111);
-        int8_t k = (get_bit(instruction,9)<< 7) | (get_bit(instruction,9)<< 6) | ((instruction & 0b0000000111111000)>>3);
+static void
+async_worker(void *arg)
+{
+    async_job *job = (async_job *)arg;
+    AVRoObject *self = job->board;
+    avr_state *state = self->core.state;
+    uint64_t start_cycle = state->cycles;
+
+    // the GIL is not held here, only this thread touches the board
+    while (!state->break_point_reached && state->cycles < job->end_cycle
+            && !__atomic_load_n(&self->async_cancel, __ATOMIC_RELAXED)) {
+        uint64_t remaining = job->end_cycle - state->cycles;
+        avr_run(&self->core, remaining < ASYNC_SLICE_CYCLES ? remaining : ASYNC_SLICE_CYCLES, AVR_UNLIMITED);
+    }
+    int flush_error = avr_uart_flush(&self->core) < 0 ? errno : 0;
 
-        // todo
-        if(!get_bit(self->sreg,position)){
-            self->program_counter+=k;
-        }
+    PyGILState_STATE gil = PyGILState_Ensure();
 
-        #ifdef DEBUG
-        printf("BRBC\n");
-        #endif
+    PyObject *value;
+    if (flush_error) {
+        value = PyObject_CallFunction(PyExc_OSError, "is", flush_error, strerror(flush_error));
+    } else {
+        value = PyLong_FromUnsignedLongLong(state->cycles - start_cycle);
+    }
+    PyObject *complete = PyCFunction_New(&async_complete_def, NULL);
+    PyObject *rv = NULL;
+    if (value != NULL && complete != NULL) {
+        rv = PyObject_CallMethod(job->loop, "call_soon_threadsafe", "OOOO",
+                                 complete, job->future, value, flush_error ? Py_True : Py_False);
+    }
+    if (rv == NULL) {
+        // most likely the loop was closed before the run finished
+        PyErr_WriteUnraisable((PyObject *)self);
+    }
+    Py_XDECREF(rv);
+    Py_XDECREF(complete);
+    Py_XDECREF(value);
+
+    Py_CLEAR(self->async_future);
+    self->running = 0;
+    Py_DECREF(job->future);
+    Py_DECREF(job->loop);
+    Py_DECREF(self);
+    PyMem_RawFree(job);
+
+    PyGILState_Release(gil);
+}
 
-    }else if(instr_check(instruction, 0b1111110000000000, 0b1111000000000000)){
-        // BRBS
-        uint8_t position = (instruction & 0b0000000000000111);
-        int8_t k = (get_bit(instruction,9)<< 7) | (get_bit(instruction,9)<< 6) | ((instruction & 0b0000000111111000)>>3);
+static PyObject *
+start_async(AVRoObject *self, uint64_t end_cycle)
+{
+    if (check_idle(self) < 0)
+        return NULL;
 
-        // todo
-        if(get_bit(self->sreg,position)){
-            self->program_counter+=k;
-        }
-        #ifdef DEBUG
-        printf("BRBS\n");
-        #endif
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRCC
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRCS
-    }else if(instr_check(instruction, 0b1111111111111111, 0b1001010110011000)){
-        // BREAK
-        self->break_point_reached = 1;
-
-        #ifdef DEBUG
-        printf("BREAK\n");
-        #endif
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BREQ
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRGE
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRHC
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRHS
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRID
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRIE
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRLO
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRLT
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRMI
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRNE
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRPL
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRSH
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRTC
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRTS
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRVC
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // BRVS
-    }else if(instr_check(instruction, 0b1111111110001111, 0b1001010000001000)){
-        // BSET
-        uint8_t position = (instruction & 0b0000000001110000) >> 4;
-        // todo
-        self->sreg = (self->sreg) | (1<<position);
-        #ifdef DEBUG
-        printf("BSET\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111000001000, 0b1111101000000000)){
-        // BST
-        uint8_t position = (instruction & 0b0000000000000111);
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4];
-        // todo
-        self->sreg = (self->sreg & 0b10111111) | (get_bit(rd,position)<<6);
-
-        #ifdef DEBUG
-        printf("BST\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // CALL
-    }else if(instr_check(instruction, 0b1111111100000000, 0b1001100000000000)){
-        // CBI
-        uint8_t position = (instruction & 0b0000000000000111);
-        uint8_t sram = self->sram[(instruction & 0b0000000011111000) >> 3];
-        self->sram[(instruction & 0b0000000011111000) >> 3] = sram & (~(1<<position));
-
-        #ifdef DEBUG
-        printf("CBI\n");
-        #endif
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // CBR, see ANDI
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000000)){
-        // COM
-        uint8_t rd = self->registers[((instruction & 0b0000000111110000) >> 4)] ;
-        uint8_t result = 255-rd;
-
-        // Update SREG
-        uint8_t c = 1;
-        uint8_t z = result == 0;
-        uint8_t n = g_r7;
-        uint8_t v = 0;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11101111) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
-
-        self->registers[((instruction & 0b0000000111110000) >> 4)] = result;
-        #ifdef DEBUG
-        printf("COM\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0001010000000000)){
-        // CP
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t rr= self->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
-        uint8_t result = rd - rr;
-
-        // Update SREG
-        uint8_t h = ( (!g_rd3) & g_rr3 ) | ( g_rr3 & g_r3 ) | ( g_r3 & (!g_rd3) );
-        uint8_t v = ( g_rd7 & (!g_rr7) & (!g_r7) ) | ((!g_rd7) & g_rr7 & g_r7);
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t c = ((!g_rd7) & g_rr7) | (g_rr7 & g_r7 ) | ( g_r7 & (!g_rd7) );
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11000000)  | (h << 5) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
-
-        #ifdef DEBUG
-        printf("CP\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0000010000000000)){
-        // CPC
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t rr= self->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
-        uint8_t result = rd - rr - get_bit(self->sreg,0);
-
-        // Update SREG
-        uint8_t h = ( (!g_rd3) & g_rr3 ) | ( g_rr3 & g_r3 ) | ( g_r3 & (!g_rd3) );
-        uint8_t v = ( g_rd7 & (!g_rr7) & (!g_r7) ) | ((!g_rd7) & g_rr7 & g_r7);
-        uint8_t n = g_r7;
-        uint8_t old_z = get_bit(self->sreg,1);
-        uint8_t z = (result == 0) & old_z;
-        uint8_t c = ((!g_rd7) & g_rr7) | (g_rr7 & g_r7 ) | ( g_r7 & (!g_rd7) );
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11000000)  | (h << 5) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
-
-
-        #ifdef DEBUG
-        printf("CPC\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111000000000000, 0b0011000000000000)){
-        // CPI
-        uint8_t rd = self->registers[16 + ((instruction & 0b0000000011110000) >> 4)] ;
-        uint8_t k = ((instruction & 0b0000111100000000) >> 4) + (instruction & 0b0000000000001111);
-        uint8_t result = rd - k;
-
-        // Update SREG
-        uint8_t h = ( (!g_rd3) & get_bit(k,3) ) | ( get_bit(k,3) & g_r3 ) | ( g_r3 & (!g_rd3) );
-        uint8_t v = ( g_rd7 & (!g_r7) & (!get_bit(k,7)) ) | ((!g_rd7) & get_bit(k,7) & g_r7);
-        uint8_t n = g_r7;
-        uint8_t old_z = get_bit(self->sreg,1);
-        uint8_t z = (result == 0) & old_z;
-        uint8_t c = ((!g_rd7) & get_bit(k,7)) | (get_bit(k,7) & g_r7 ) | ( g_r7 & (!g_rd7) );
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11000000)  | (h << 5) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
-
-
-        #ifdef DEBUG
-        printf("CPI\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0001000000000000)){
-        // CPSE
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t rr= self->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
-        uint8_t result = rd - rr;
-
-        if(result == 0){
-            //todo, 2 word instruction check, then program_counter+=2
-            self->program_counter+=1;
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL)
+        return NULL;
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if (loop == NULL)
+        return NULL;
 
-        }
+    PyObject *future = PyObject_CallMethod(loop, "create_future", NULL);
+    if (future == NULL) {
+        Py_DECREF(loop);
+        return NULL;
+    }
 
-        #ifdef DEBUG
-        printf("CPSE\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000001010)){
-        // DEC
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t result = rd - 1;
-
-        uint8_t v = rd == 128;
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11100001) | (s <<4) | (v <<3) | (n <<2) | (z <<1);
-
-        #ifdef DEBUG
-        printf("DEC\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // DES
-    }else if(NOT_IMPLEMENTED){
-        // EICALL
-    }else if(NOT_IMPLEMENTED){
-        // EIJMP
-    }else if(NOT_IMPLEMENTED){
-        // ELPM
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0010010000000000)){
-        // EOR
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t rr= self->registers[(instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5)];
-        uint8_t result = rd ^ rr;
-
-        uint8_t v = 0;
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11100001) | (s <<4) | (v <<3) | (n <<2) | (z <<1);
-
-        self->registers[(instruction & 0b0000000111110000) >> 4] = result;
-        #ifdef DEBUG
-        printf("EOR\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // FMUL
-    }else if(NOT_IMPLEMENTED){
-        // FMULS
-    }else if(NOT_IMPLEMENTED){
-        // FMULSU
-    }else if(NOT_IMPLEMENTED){
-        // ICALL
-    }else if(NOT_IMPLEMENTED){
-        // IJMP
-    }else if(instr_check(instruction, 0b1111100000000000, 0b1011000000000000)){
-        // IN
-        uint8_t d = (instruction & 0b0000000111110000) >> 4;
-        uint8_t A  = ((instruction & 0b0000011000000000) >> 9) + (instruction & 0b0000000000001111);
-
-        self->registers[d] = self->io_registers[A];
-
-        #ifdef DEBUG
-        printf("IN\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000011)){
-        // INC
-        uint8_t rd = self->registers[(instruction & 0b0000000111110000) >> 4] ;
-        uint8_t result = rd + 1;
-
-        uint8_t v = result == 127;
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11000000)  | (s << 4) | (v << 3) | (n << 2) | (z << 1);
-
-        self->registers[(instruction & 0b0000000111110000) >> 4] = result;
-        #ifdef DEBUG
-        printf("INC\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // JMP
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001001000000100)){
-        // LAC
-        uint8_t d = (instruction & 0b0000000111110000) >> 4;
-        uint8_t rd = self->registers[d];
-
-        self->registers[d] = self->registers[z_register];
-        self->registers[z_register] = (255 - rd) & self->registers[z_register]; //todo, not sure if right
-
-        #ifdef DEBUG
-        printf("LAC\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001001000000101)){
-        // LAS
-        uint8_t d = (instruction & 0b0000000111110000) >> 4;
-        uint8_t rd = self->registers[d];
-
-        self->registers[d] = self->registers[z_register];
-        self->registers[z_register] = rd | self->registers[z_register]; //todo, not sure if right
-        #ifdef DEBUG
-        printf("LAS\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001001000000111)){
-        // LAT
-        uint8_t d = (instruction & 0b0000000111110000) >> 4;
-        uint8_t rd = self->registers[d];
-
-        self->registers[d] = self->registers[z_register];
-        self->registers[z_register] = rd ^ self->registers[z_register]; //todo, not sure if right
-
-        #ifdef DEBUG
-        printf("LAT\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // LD
-    }else if(instr_check(instruction, 0b1111000000000000, 0b1110000000000000)){
-        // LDI
-        uint8_t d = 16 + ((instruction & 0b0000000011110000) >> 4);
-        uint8_t k = (instruction & 0b0000000000001111) + ((instruction & 0b0000111100000000)>>4);
-
-        self->registers[d] = k;
-        #ifdef DEBUG
-        printf("LDI\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // LDS
-    }else if(NOT_IMPLEMENTED){
-        // LPM
-    }else if(NOT_IMPLEMENTED){
-        // LSL, same as ADD Rd, Rd
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000110)){
-        // LSR
-        uint8_t d = (instruction & 0b0000000111110000) >> 4;
-        uint8_t rd = self->registers[d];
-
-        uint8_t result = rd >> 1 ;
-
-        uint8_t n = 0;
-        uint8_t z = result == 0;
-        uint8_t c = get_bit(rd,0);
-        uint8_t v = n ^ c;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11000000)  | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
-
-        #ifdef DEBUG
-        printf("LSR\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0010110000000000)){
-        // MOV
-        uint8_t d = (instruction & 0b0000000111110000) >> 4;
-        uint8_t r= (instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5);
-
-        self->registers[d] = self->registers[r];
-
-        #ifdef DEBUG
-        printf("MOV\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // MOVW
-    }else if(NOT_IMPLEMENTED){
-        // MUL
-    }else if(NOT_IMPLEMENTED){
-        // MULS
-    }else if(NOT_IMPLEMENTED){
-        // LMULSU
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000001)){
-        // NEG
-        uint8_t d = (instruction & 0b0000000111110000) >> 4;
-
-        uint8_t rd = self->registers[d];
-
-        uint8_t result = 255 - rd;
-
-        uint8_t h = g_r3 | (!g_rd3);
-        uint8_t v = result == 128;
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t c = result != 0;
-        uint8_t s = n ^ v;
-
-        self->sreg = (self->sreg & 0b11000000) | (h << 4) | (s << 4) | (v << 3) | (n << 2) | (z << 1) | c;
-
-        self->registers[d] = result;
-
-        #ifdef DEBUG
-        printf("NEG\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0010100000000000)){
-        // OR
-        uint8_t d = (instruction & 0b0000000111110000) >> 4;
-        uint8_t r = (instruction & 0b0000000000001111) + ((instruction & 0b0000001000000000) >> 5);
-
-        uint8_t rd = self->registers[d];
-        uint8_t rr = self->registers[r];
-
-        uint8_t result = rd | rr;
-
-        uint8_t v = 0;
-        uint8_t n = g_r7;
-        uint8_t z = result == 0;
-        uint8_t s = n ^ v;
-        self->sreg = (self->sreg & 0b11100001) | (s << 4) | (v << 3) | (n << 2) | (z << 1) ;
-
-        self->registers[d] = result;
-
-        #ifdef DEBUG
-        printf("OR\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111000000000000, 0b0110000000000000)){
-        // ORI
-        #ifdef DEBUG
-        printf("ORI\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111100000000000, 0b1011100000000000)){
-        // OUT
-        #ifdef DEBUG
-        printf("OUT\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // POP
-    }else if(NOT_IMPLEMENTED){
-        // PUSH
-    }else if(NOT_IMPLEMENTED){
-        // RCALL
-    }else if(NOT_IMPLEMENTED){
-        // RET
-    }else if(NOT_IMPLEMENTED){
-        // RETI
-    }else if(instr_check(instruction, 0b1111000000000000, 0b1100000000000000)){
-        // RJMP
-        #ifdef DEBUG
-        printf("RJMP\n");
-        #endif
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // ROL, same as ADC Rd, Rd
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000111)){
-        // ROR
-        #ifdef DEBUG
-        printf("ROR\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0000100000000000)){
-        // SBC
-        #ifdef DEBUG
-        printf("SBC\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111000000000000, 0b0100000000000000)){
-        // SBCI
-        #ifdef DEBUG
-        printf("SBCI\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111100000000, 0b1001101000000000)){
-        // SBI
-        #ifdef DEBUG
-        printf("SBI\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111100000000, 0b1001100100000000)){
-        // SBIC
-        #ifdef DEBUG
-        printf("SBIC\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111100000000, 0b1001101100000000)){
-        // SBIS
-        #ifdef DEBUG
-        printf("SBIS\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // SBIW
-    }else if(GENERALIZATION_IMPLEMENTED){
-        // SBR, ORI Rd, K
-    }else if(instr_check(instruction, 0b1111111000001000, 0b1111110000000000)){
-        // SBRC
-        #ifdef DEBUG
-        printf("SBRC\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111000001000, 0b1111111000000000)){
-        // SBRS
-        #ifdef DEBUG
-        printf("SBRS\n");
-        #endif
-    }else if (GENERALIZATION_IMPLEMENTED){
-        // SER, LDI
-    }else if(instr_check(instruction, 0b1111111111111111, 0b1001010110001000)){
-        // SLEEP
-        #ifdef DEBUG
-        printf("SLEEP\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // SPM
-    }else if(NOT_IMPLEMENTED){
-        // ST
-    }else if(NOT_IMPLEMENTED){
-        // STS
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0001100000000000)){
-        // SUB
-        #ifdef DEBUG
-        printf("SUB\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111000000000000, 0b0101000000000000)){
-        // SUBI
-        #ifdef DEBUG
-        printf("SUBI\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111111000001111, 0b1001010000000010)){
-        // SWAP
-        #ifdef DEBUG
-        printf("SWAP\n");
-        #endif
-    }else if(instr_check(instruction, 0b1111110000000000, 0b0010000000000000)){
-        // TST
-        #ifdef DEBUG
-        printf("TST\n");
-        #endif
-    }else if(NOT_IMPLEMENTED){
-        // WDR
-    }else if(NOT_IMPLEMENTED){
-        // XCH
-    }
-
-    self->program_counter+=1;
+    PyObject *done_callback = PyObject_GetAttrString((PyObject *)self, "_async_done");
+    PyObject *rv = NULL;
+    if (done_callback != NULL) {
+        rv = PyObject_CallMethod(future, "add_done_callback", "O", done_callback);
+        Py_DECREF(done_callback);
+    }
+    if (rv == NULL) {
+        Py_DECREF(future);
+        Py_DECREF(loop);
+        return NULL;
+    }
+    Py_DECREF(rv);
 
-    return 0;
+    async_job *job = PyMem_RawMalloc(sizeof(async_job));
+    if (job == NULL) {
+        Py_DECREF(future);
+        Py_DECREF(loop);
+        return PyErr_NoMemory();
+    }
+    Py_INCREF(self);
+    Py_INCREF(future);
+    job->board = self;
+    job->loop = loop;
+    job->future = future;
+    job->end_cycle = end_cycle;
+
+    self->running = 1;
+    __atomic_store_n(&self->async_cancel, 0, __ATOMIC_RELAXED);
+    self->async_future = future;
+    Py_INCREF(future);
+
+    if (PyThread_start_new_thread(async_worker, job) == PYTHREAD_INVALID_THREAD_ID) {
+        Py_CLEAR(self->async_future);
+        self->running = 0;
+        Py_DECREF(self);
+        Py_DECREF(future);
+        Py_DECREF(loop);
+        PyMem_RawFree(job);
+        Py_DECREF(future);
+        PyErr_SetString(PyExc_RuntimeError, "can't start AVR worker thread");
+        return NULL;
+    }
+    return future;
 }
 
 static PyObject *
-AVRo_run_next_instruction(AVRoObject *self, PyObject *args)
+AVRo_run_async(AVRoObject *self, PyObject *args, PyObject *keywds)
 {
-    run_instruction(self);
-    Py_RETURN_NONE;
-}
+    uint64_t cycles;
 
+    static char *kwlist[] = {"cycles", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "K", kwlist, &cycles))
+        return NULL;
+
+    uint64_t end_cycle = self->core.state->cycles + cycles;
+    if (end_cycle < self->core.state->cycles)
+        end_cycle = UINT64_MAX;
+    return start_async(self, end_cycle);
+}
 
 static PyObject *
-AVRo_run_until_break(AVRoObject *self, PyObject *args)
+AVRo_wait_for_break(AVRoObject *self, PyObject *args)
 {
-    while(!self->break_point_reached){
-        run_instruction(self);
-    }
-
-    Py_RETURN_NONE;
+    return start_async(self, UINT64_MAX);
 }
 
+// done callback of the worker future, stops the worker when it was cancelled
 static PyObject *
-AVRo_run_instructions(AVRoObject *self, PyObject *args)
+AVRo_async_done(AVRoObject *self, PyObject *future)
 {
-    // todo: Run X instructions
-    uint64_t number_of_instructions;
-    uint64_t executed_instructions = 0;
-    if (!PyArg_ParseTuple(args, "k", &number_of_instructions)){
-        //todo
+    if (future != self->async_future)
         Py_RETURN_NONE;
-    }
-
-    while(executed_instructions < number_of_instructions){ // todo: Add Break instruction additionally
-        run_instruction(self);
-        executed_instructions+=1;
-    }
-
 
+    PyObject *cancelled = PyObject_CallMethod(future, "cancelled", NULL);
+    if (cancelled == NULL)
+        return NULL;
+    if (PyObject_IsTrue(cancelled))
+        __atomic_store_n(&self->async_cancel, 1, __ATOMIC_RELAXED);
+    Py_DECREF(cancelled);
     Py_RETURN_NONE;
 }
 
 
 static PyMethodDef AVRo_methods[] = {
-    {"get_sreg",                (PyCFunction)AVRo_get_sreg,                             METH_VARARGS,                   PyDoc_STR("get SREG")},
-    {"set_sreg",                (PyCFunction)AVRo_set_sreg,                             METH_VARARGS,                   PyDoc_STR("set SREG")},
-    {"get_register",            (PyCFunction)AVRo_get_register,                         METH_VARARGS,                   PyDoc_STR("set SREG")},
-    {"set_register",            (PyCFunction)(void(*)(void))AVRo_set_register,          METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("updates register")},
-    {"get_program_counter",     (PyCFunction)AVRo_get_program_counter,                  METH_VARARGS,                   PyDoc_STR("Get program counter")},
-    {"set_program_memory",      (PyCFunction)(void(*)(void))AVRo_set_program_memory,    METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Set the program memory")},
-    {"get_program_memory",      (PyCFunction)AVRo_get_program_memory,                   METH_VARARGS,                   PyDoc_STR("Get program counter")},
+    {"get_sreg",                (PyCFunction)AVRo_get_sreg,                             METH_NOARGS,                    PyDoc_STR("get SREG")},
+    {"set_sreg",                (PyCFunction)AVRo_set_sreg,                             METH_O,                         PyDoc_STR("set SREG")},
+    {"get_register",            (PyCFunction)AVRo_get_register,                         METH_O,                         PyDoc_STR("set SREG")},
+    {"set_register",            (PyCFunction)(void(*)(void))AVRo_set_register,          METH_FASTCALL | METH_KEYWORDS,  PyDoc_STR("updates register")},
+    {"get_registers",           (PyCFunction)AVRo_get_registers,                        METH_NOARGS,                    PyDoc_STR("Get all registers as bytes")},
+    {"set_registers",           (PyCFunction)AVRo_set_registers,                        METH_VARARGS,                   PyDoc_STR("Set registers from r0 upwards from a bytes-like object")},
+    {"get_program_counter",     (PyCFunction)AVRo_get_program_counter,                  METH_NOARGS,                    PyDoc_STR("Get program counter")},
+    {"set_program_memory",      (PyCFunction)(void(*)(void))AVRo_set_program_memory,    METH_FASTCALL | METH_KEYWORDS,  PyDoc_STR("Set the program memory")},
+    {"set_program_memory_block", (PyCFunction)AVRo_set_program_memory_block,             METH_VARARGS,                   PyDoc_STR("Set program memory from offset with little endian words")},
+    {"get_program_memory",      (PyCFunction)AVRo_get_program_memory,                   METH_O,                         PyDoc_STR("Get program counter")},
     {"get_program_memory_size", (PyCFunction)AVRo_get_program_memory_size,              METH_VARARGS,                   PyDoc_STR("Get program memory size")},
     {"get_sram_size",           (PyCFunction)AVRo_get_sram_size,                        METH_VARARGS,                   PyDoc_STR("Get sram size")},
-    {"run_next_instruction",    (PyCFunction)AVRo_run_next_instruction,                 METH_VARARGS,                   PyDoc_STR("Run a single instruction")},
+    {"run_next_instruction",    (PyCFunction)AVRo_run_next_instruction,                 METH_NOARGS,                    PyDoc_STR("Run a single instruction")},
     {"run_until_break",         (PyCFunction)AVRo_run_until_break,                      METH_VARARGS,                   PyDoc_STR("Run up to and including the Break instruction")},
-    {"run_instructions",        (PyCFunction)AVRo_run_instructions,                     METH_VARARGS,                   PyDoc_STR("Run x instructions")},
+    {"run_instructions",        (PyCFunction)AVRo_run_instructions,                     METH_VARARGS,                   PyDoc_STR("Run up to x instructions, stops early at BREAK")},
+    {"run_async",               (PyCFunction)(void(*)(void))AVRo_run_async,             METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Run x cycles on a worker thread, returns an asyncio future")},
+    {"wait_for_break",          (PyCFunction)AVRo_wait_for_break,                       METH_NOARGS,                    PyDoc_STR("Run up to the Break instruction on a worker thread, returns an asyncio future")},
+    {"_async_done",             (PyCFunction)AVRo_async_done,                           METH_O,                         NULL},
+    {"run_paced",               (PyCFunction)(void(*)(void))AVRo_run_paced,             METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Run x cycles locked to the wall clock at the given frequency, returns timing statistics")},
+    {"get_io_register",         (PyCFunction)AVRo_get_io_register,                      METH_O,                         PyDoc_STR("Get an io register")},
+    {"set_io_register",         (PyCFunction)(void(*)(void))AVRo_set_io_register,       METH_FASTCALL,                  PyDoc_STR("Set an io register without peripheral side effects")},
+    {"get_cycles",              (PyCFunction)AVRo_get_cycles,                           METH_NOARGS,                    PyDoc_STR("Get the cycle counter")},
+    {"get_instructions",        (PyCFunction)AVRo_get_instructions,                     METH_NOARGS,                    PyDoc_STR("Get the number of instructions executed")},
+    {"load_image",              (PyCFunction)AVRo_load_image,                           METH_VARARGS,                   PyDoc_STR("Load an Intel HEX or raw binary firmware image into the program memory")},
+    {"attach_flash",            (PyCFunction)(void(*)(void))AVRo_attach_flash,          METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Load the program memory from a file mapping and write SPM changes to it")},
+    {"attach_eeprom",           (PyCFunction)(void(*)(void))AVRo_attach_eeprom,         METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Load the eeprom from a file mapping and write changes to it")},
+    {"detach_flash",            (PyCFunction)AVRo_detach_flash,                         METH_NOARGS,                    PyDoc_STR("Unmap the program memory file, the contents stay")},
+    {"detach_eeprom",           (PyCFunction)AVRo_detach_eeprom,                        METH_NOARGS,                    PyDoc_STR("Unmap the eeprom file, the contents stay")},
+    {"get_eeprom",              (PyCFunction)AVRo_get_eeprom,                           METH_NOARGS,                    PyDoc_STR("Get the eeprom contents as bytes")},
+    {"set_eeprom",              (PyCFunction)AVRo_set_eeprom,                           METH_VARARGS,                   PyDoc_STR("Write bytes into the eeprom from offset")},
+    {"uart_write",              (PyCFunction)AVRo_uart_write,                           METH_VARARGS,                   PyDoc_STR("Queue bytes for the UART receiver, returns the number accepted")},
+    {"uart_read",               (PyCFunction)AVRo_uart_read,                            METH_VARARGS,                   PyDoc_STR("Take up to size bytes sent by the UART")},
+    {"uart_readinto",           (PyCFunction)AVRo_uart_readinto,                        METH_VARARGS,                   PyDoc_STR("Move bytes sent by the UART into a writable buffer")},
+    {"uart_set_tx_fd",          (PyCFunction)AVRo_uart_set_tx_fd,                       METH_VARARGS,                   PyDoc_STR("Stream UART output to a file descriptor, -1 to buffer it")},
+    {"uart_get_stats",          (PyCFunction)AVRo_uart_get_stats,                       METH_VARARGS,                   PyDoc_STR("Get UART buffer fill levels and overruns")},
+    {"set_coverage_map",        (PyCFunction)AVRo_set_coverage_map,                     METH_O,                         PyDoc_STR("Count control flow edges into a writable 64 KiB buffer, None to stop")},
+    {"take_snapshot",           (PyCFunction)AVRo_take_snapshot,                        METH_NOARGS,                    PyDoc_STR("Get the whole machine state as bytes")},
+    {"restore_snapshot",        (PyCFunction)AVRo_restore_snapshot,                     METH_VARARGS,                   PyDoc_STR("Set the whole machine state from take_snapshot bytes")},
+    {"record_start",            (PyCFunction)AVRo_record_start,                         METH_NOARGS,                    PyDoc_STR("Start logging host inputs with their cycle")},
+    {"record_stop",             (PyCFunction)AVRo_record_stop,                          METH_NOARGS,                    PyDoc_STR("Stop logging host inputs, returns the log as bytes")},
+    {"replay",                  (PyCFunction)(void(*)(void))AVRo_replay,                METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Run to the end of a recorded log, feeding its inputs at their cycles")},
+    {"history_start",           (PyCFunction)(void(*)(void))AVRo_history_start,         METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Keep a checkpoint every interval cycles for reverse execution, at most limit of them")},
+    {"history_stop",            (PyCFunction)AVRo_history_stop,                         METH_NOARGS,                    PyDoc_STR("Drop the checkpoints and stop keeping them")},
+    {"history_get_stats",       (PyCFunction)AVRo_history_get_stats,                    METH_NOARGS,                    PyDoc_STR("Get the number and memory size of the checkpoints, None without history")},
+    {"step_back",               (PyCFunction)AVRo_step_back,                            METH_VARARGS,                   PyDoc_STR("Undo the last n instructions")},
+    {"run_back_to",             (PyCFunction)(void(*)(void))AVRo_run_back_to,           METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Go back to the last time the program counter was pc, or to cycle")},
+    {"last_write",              (PyCFunction)AVRo_last_write,                           METH_O,                         PyDoc_STR("Find the last instruction that wrote to a data space address")},
+    {"fault_campaign",          (PyCFunction)(void(*)(void))AVRo_fault_campaign,        METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Run every (cycle, target, address, mask) bit flip from the current state in parallel, returns one OUTCOME_* byte per fault")},
+    {"validate",                (PyCFunction)(void(*)(void))AVRo_validate,              METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Run the fast engine against the reference interpreter from the current state, returns None or the first divergence")},
+    {"_validate_injected",      (PyCFunction)AVRo_validate_injected,                    METH_VARARGS,                   NULL},
+    {"fuzz_run",                (PyCFunction)(void(*)(void))AVRo_fuzz_run,              METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("Restore a snapshot, feed data to the UART or to address and run, returns FUZZ_BREAK or FUZZ_TIMEOUT")},
     {NULL,              NULL}           /* sentinel */
 };
 
@@ -951,12 +1531,444 @@ avr_new(PyObject *self, PyObject *args)
 
 /* ---------- */
 
+static PyObject *
+bench_result_to_dict(const avr_bench_result *result)
+{
+    return Py_BuildValue("{s:s,s:s,s:K,s:K,s:K,s:d,s:d,s:d}",
+                         "kernel", result->kernel->name,
+                         "class", result->kernel->instruction_class,
+                         "instructions", (unsigned long long)result->instructions,
+                         "cycles", (unsigned long long)result->cycles,
+                         "elapsed_ns", (unsigned long long)result->elapsed_ns,
+                         "mips", result->mips,
+                         "ns_per_instruction", result->ns_per_instruction,
+                         "cycles_per_second", result->cycles_per_second);
+}
+
+/* Run the built in benchmark kernels, returns a list of result dicts */
+
+static PyObject *
+avr_benchmark(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    const char *only = NULL;
+    unsigned long long instructions = 1000000;
+    int repeats = 3;
+
+    static char *kwlist[] = {"kernel", "instructions", "repeats", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|zKi", kwlist, &only, &instructions, &repeats))
+        return NULL;
+    if (only != NULL && avr_bench_find(only) == NULL) {
+        PyErr_Format(PyExc_ValueError, "unknown kernel: %s", only);
+        return NULL;
+    }
+
+    PyObject *results = PyList_New(0);
+    if (results == NULL)
+        return NULL;
+
+    for (const avr_bench_kernel *kernel = avr_bench_kernels; kernel->name != NULL; kernel++) {
+        avr_bench_result result;
+        int rv;
+
+        if (only != NULL && strcmp(kernel->name, only) != 0)
+            continue;
+
+        Py_BEGIN_ALLOW_THREADS
+        rv = avr_bench_run(kernel, instructions, repeats, &result);
+        Py_END_ALLOW_THREADS
+        if (rv < 0) {
+            Py_DECREF(results);
+            return PyErr_NoMemory();
+        }
+
+        PyObject *item = bench_result_to_dict(&result);
+        if (item == NULL || PyList_Append(results, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(results);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return results;
+}
+
+static PyObject *
+avr_init_block(PyObject *self, PyObject *arg)
+{
+    Py_buffer block;
+    if (PyObject_GetBuffer(arg, &block, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0)
+        return NULL;
+
+    int rv = avr_block_init(block.buf, (size_t)block.len);
+    PyBuffer_Release(&block);
+    if (rv < 0) {
+        PyErr_Format(PyExc_ValueError, "a state block needs %zu bytes at an 8 byte aligned address",
+                     (size_t)AVR_BLOCK_SIZE);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// the board keeps the buffer exported, a shared memory segment can't be closed under it
+static PyObject *
+avr_attach(PyObject *self, PyObject *arg)
+{
+    AVRoObject *rv = newAVRoObject(NULL);
+    if (rv == NULL)
+        return NULL;
+    if (PyObject_GetBuffer(arg, &rv->block, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0) {
+        Py_DECREF(rv);
+        return NULL;
+    }
+
+    avr_state *state = avr_block_attach(rv->block.buf, (size_t)rv->block.len);
+    if (state == NULL) {
+        PyErr_SetString(PyExc_ValueError, "not a state block of this emulator, see init_block()");
+        Py_DECREF(rv);
+        return NULL;
+    }
+    rv->core.state = state;
+    return (PyObject *)rv;
+}
+
+// byte offset and size of every field of a state block, for reading it without a board
+static PyObject *
+avr_state_layout(PyObject *self, PyObject *unused)
+{
+    #define FIELD(name, member) {name, sizeof(avr_block_header) + offsetof(avr_state, member), \
+                                 sizeof(((avr_state *)0)->member)}
+    static const struct { const char *name; size_t offset, size; } fields[] = {
+        {"magic", offsetof(avr_block_header, magic), sizeof(uint32_t)},
+        {"version", offsetof(avr_block_header, version), sizeof(uint32_t)},
+        {"size", offsetof(avr_block_header, size), sizeof(uint64_t)},
+        FIELD("sreg", sreg),
+        FIELD("registers", registers),
+        FIELD("io_registers", io_registers),
+        FIELD("sram", sram),
+        FIELD("program_memory", program_memory),
+        FIELD("program_counter", program_counter),
+        FIELD("break_point_reached", break_point_reached),
+        FIELD("cycles", cycles),
+        FIELD("instructions", instructions),
+        FIELD("eeprom", eeprom.data),
+        // free running ring indices, avr_state_check rejects more than a ring between them
+        FIELD("uart.rx.head", uart.rx.head),
+        FIELD("uart.rx.tail", uart.rx.tail),
+        FIELD("uart.tx.head", uart.tx.head),
+        FIELD("uart.tx.tail", uart.tx.tail),
+        FIELD("spi.rx.head", spi.rx.head),
+        FIELD("spi.rx.tail", spi.rx.tail),
+        FIELD("spi.tx.head", spi.tx.head),
+        FIELD("spi.tx.tail", spi.tx.tail),
+    };
+    #undef FIELD
+
+    PyObject *layout = PyDict_New();
+    if (layout == NULL)
+        return NULL;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        PyObject *field = Py_BuildValue("(nn)", (Py_ssize_t)fields[i].offset, (Py_ssize_t)fields[i].size);
+        if (field == NULL || PyDict_SetItemString(layout, fields[i].name, field) < 0) {
+            Py_XDECREF(field);
+            Py_DECREF(layout);
+            return NULL;
+        }
+        Py_DECREF(field);
+    }
+    return layout;
+}
+
+static PyObject *
+avr_diff_snapshots(PyObject *self, PyObject *args)
+{
+    Py_buffer a, b;
+    PyObject *rv = NULL;
+
+    if (!PyArg_ParseTuple(args, "y*y*", &a, &b))
+        return NULL;
+    if (a.len != sizeof(avr_state) || b.len != sizeof(avr_state))
+        PyErr_SetString(PyExc_ValueError, "not a snapshot of this emulator");
+    else
+        rv = state_diff(a.buf, b.buf);
+    PyBuffer_Release(&a);
+    PyBuffer_Release(&b);
+    return rv;
+}
+
+static PyObject *
+avr_benchmark_kernels(PyObject *self, PyObject *unused)
+{
+    PyObject *kernels = PyList_New(0);
+    if (kernels == NULL)
+        return NULL;
+
+    for (const avr_bench_kernel *kernel = avr_bench_kernels; kernel->name != NULL; kernel++) {
+        PyObject *item = Py_BuildValue("(ss)", kernel->name, kernel->instruction_class);
+        if (item == NULL || PyList_Append(kernels, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(kernels);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return kernels;
+}
+
+/* Run several boards wired together, each on its own thread */
+
+static PyObject *
+avr_run_system(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *boards_arg, *links_arg, *boards = NULL, *links = NULL, *result = NULL;
+    unsigned long long cycles, quantum = SYSTEM_QUANTUM;
+    avr_core **cores = NULL;
+    avr_link *wiring = NULL;
+    Py_ssize_t count = 0, link_count, i;
+    int rv;
+
+    static char *kwlist[] = {"boards", "links", "cycles", "quantum", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "OOK|K", kwlist, &boards_arg, &links_arg, &cycles, &quantum))
+        return NULL;
+    if (quantum == 0) {
+        PyErr_SetString(PyExc_ValueError, "quantum must be positive");
+        return NULL;
+    }
+    boards = PySequence_Fast(boards_arg, "boards must be a sequence");
+    links = PySequence_Fast(links_arg, "links must be a sequence");
+    if (boards == NULL || links == NULL)
+        goto done;
+
+    count = PySequence_Fast_GET_SIZE(boards);
+    link_count = PySequence_Fast_GET_SIZE(links);
+    if (count < 1) {
+        PyErr_SetString(PyExc_ValueError, "a system needs at least one board");
+        goto done;
+    }
+    cores = PyMem_New(avr_core *, count);
+    wiring = PyMem_New(avr_link, link_count ? link_count : 1);
+    if (cores == NULL || wiring == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        AVRoObject *board = (AVRoObject *)PySequence_Fast_GET_ITEM(boards, i);
+        if (!AVRoObject_Check(board)) {
+            PyErr_SetString(PyExc_TypeError, "boards must be AVR objects");
+            goto done;
+        }
+        // bus traffic from the other boards is not logged
+        if (check_unrecorded(board) < 0)
+            goto done;
+        for (Py_ssize_t j = 0; j < i; j++) {
+            if (cores[j] == &board->core) {
+                PyErr_SetString(PyExc_ValueError, "a board can only appear once");
+                goto done;
+            }
+        }
+        cores[i] = &board->core;
+    }
+    for (i = 0; i < link_count; i++) {
+        avr_link *link = &wiring[i];
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(links, i), "iii;link must be (kind, a, b)",
+                              &link->kind, &link->a, &link->b))
+            goto done;
+        if (link->kind != AVR_LINK_UART && link->kind != AVR_LINK_SPI) {
+            PyErr_Format(PyExc_ValueError, "link %zd: unknown kind %d", i, link->kind);
+            goto done;
+        }
+        if (link->a < 0 || link->a >= count || link->b < 0 || link->b >= count || link->a == link->b) {
+            PyErr_Format(PyExc_IndexError, "link %zd: board index out of range", i);
+            goto done;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+        ((AVRoObject *)PySequence_Fast_GET_ITEM(boards, i))->running = 1;
+    Py_BEGIN_ALLOW_THREADS
+    rv = avr_system_run(cores, (int)count, wiring, (int)link_count, cycles, quantum);
+    Py_END_ALLOW_THREADS
+    for (i = 0; i < count; i++)
+        ((AVRoObject *)PySequence_Fast_GET_ITEM(boards, i))->running = 0;
+
+    if (rv < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        goto done;
+    }
+    for (i = 0; i < count; i++) {
+        if (finish_run((AVRoObject *)PySequence_Fast_GET_ITEM(boards, i)) < 0)
+            goto done;
+    }
+    Py_INCREF(Py_None);
+    result = Py_None;
+
+ done:
+    PyMem_Free(cores);
+    PyMem_Free(wiring);
+    Py_XDECREF(boards);
+    Py_XDECREF(links);
+    return result;
+}
+
+
+/* C API, see avr_capi.h */
+
+// the board behind a C API call, NULL with an exception set if it can't be used now
+static AVRoObject *
+capi_board(PyObject *board)
+{
+    if (!AVRoObject_Check(board)) {
+        PyErr_Format(PyExc_TypeError, "expected an AVR object, got %.200s", Py_TYPE(board)->tp_name);
+        return NULL;
+    }
+    if (check_idle((AVRoObject *)board) < 0)
+        return NULL;
+    return (AVRoObject *)board;
+}
+
+static avr_state *
+capi_get_state(PyObject *board)
+{
+    AVRoObject *self = capi_board(board);
+    return self == NULL ? NULL : self->core.state;
+}
+
+static int
+capi_changed(PyObject *board)
+{
+    AVRoObject *self = capi_board(board);
+    if (self == NULL)
+        return -1;
+    avr_history_mark(&self->core);
+    return 0;
+}
+
+static int
+capi_step(PyObject *board)
+{
+    AVRoObject *self = capi_board(board);
+    if (self == NULL)
+        return -1;
+    avr_run_instruction(&self->core);
+    return finish_run(self);
+}
+
+static int64_t
+capi_run(PyObject *board, uint64_t max_cycles, uint64_t max_instructions)
+{
+    AVRoObject *self = capi_board(board);
+    if (self == NULL)
+        return -1;
+    uint64_t executed = avr_run(&self->core, max_cycles, max_instructions);
+    if (finish_run(self) < 0)
+        return -1;
+    return executed > INT64_MAX ? INT64_MAX : (int64_t)executed;
+}
+
+static int
+capi_io_read(PyObject *board, uint8_t address, uint8_t *value)
+{
+    AVRoObject *self = capi_board(board);
+    if (self == NULL)
+        return -1;
+    if (address >= IO_REGISTER_SIZE) {
+        PyErr_SetString(PyExc_IndexError, "index out of range");
+        return -1;
+    }
+    // reads have side effects too, e.g. reading UDR clears RXC
+    if (check_unrecorded(self) < 0)
+        return -1;
+    *value = avr_io_read(&self->core, address);
+    avr_history_mark(&self->core);
+    return 0;
+}
+
+static int
+capi_io_write(PyObject *board, uint8_t address, uint8_t value)
+{
+    AVRoObject *self = capi_board(board);
+    if (self == NULL)
+        return -1;
+    if (address >= IO_REGISTER_SIZE) {
+        PyErr_SetString(PyExc_IndexError, "index out of range");
+        return -1;
+    }
+    if (check_unrecorded(self) < 0)
+        return -1;
+    avr_io_write(&self->core, address, value);
+    avr_history_mark(&self->core);
+    return finish_run(self);
+}
+
+static int
+capi_set_io_hook(PyObject *board, const avr_io_hook *hook)
+{
+    AVRoObject *self = capi_board(board);
+    if (self == NULL)
+        return -1;
+    if (hook == NULL || hook->mask == 0) {
+        memset(&self->core.io_hook, 0, sizeof(self->core.io_hook));
+        return 0;
+    }
+    if (self->core.record != NULL || self->core.history != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot set an io hook while recording or keeping history");
+        return -1;
+    }
+    self->core.io_hook = *hook;
+    return 0;
+}
+
+static int
+capi_take_snapshot(PyObject *board, void *snapshot)
+{
+    AVRoObject *self = capi_board(board);
+    if (self == NULL)
+        return -1;
+    memcpy(snapshot, self->core.state, sizeof(avr_state));
+    return 0;
+}
+
+static int
+capi_restore_snapshot(PyObject *board, const void *snapshot)
+{
+    AVRoObject *self = capi_board(board);
+    if (self == NULL)
+        return -1;
+    Py_buffer buffer = {.buf = (void *)snapshot, .len = sizeof(avr_state)};
+    return restore_from_buffer(self, &buffer);
+}
+
+static const avr_capi avr_c_api = {
+    .version = AVR_CAPI_VERSION,
+    .size = sizeof(avr_capi),
+    .snapshot_size = sizeof(avr_state),
+    .board_type = &AVRo_Type,
+    .get_state = capi_get_state,
+    .changed = capi_changed,
+    .step = capi_step,
+    .run = capi_run,
+    .io_read = capi_io_read,
+    .io_write = capi_io_write,
+    .set_io_hook = capi_set_io_hook,
+    .take_snapshot = capi_take_snapshot,
+    .restore_snapshot = capi_restore_snapshot,
+};
+
 
 /* List of functions defined in the module */
 
 // https://docs.python.org/3/c-api/structures.html?highlight=pymethoddef#c.PyMethodDef
 static PyMethodDef avr_methods[] = {
     {"new",             avr_new,         METH_VARARGS,           PyDoc_STR("new() -> new AVR object")},
+    {"benchmark",       (PyCFunction)(void(*)(void))avr_benchmark,  METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("benchmark(kernel=None, instructions=1000000, repeats=3) -> list of result dicts")},
+    {"benchmark_kernels", avr_benchmark_kernels,  METH_NOARGS,      PyDoc_STR("benchmark_kernels() -> list of (name, class)")},
+    {"run_system",      (PyCFunction)(void(*)(void))avr_run_system,  METH_VARARGS | METH_KEYWORDS,   PyDoc_STR("run_system(boards, links, cycles, quantum=1024) -> run boards wired by (kind, a, b) links in parallel")},
+    {"init_block",      avr_init_block,  METH_O,                 PyDoc_STR("init_block(buffer) -> write a reset machine state into a writable buffer of STATE_BLOCK_SIZE bytes")},
+    {"attach",          avr_attach,      METH_O,                 PyDoc_STR("attach(buffer) -> new AVR object running the state block in buffer in place")},
+    {"state_layout",    avr_state_layout, METH_NOARGS,           PyDoc_STR("state_layout() -> dict of field name to (offset, size) in a state block")},
+    {"diff_snapshots",  avr_diff_snapshots, METH_VARARGS,        PyDoc_STR("diff_snapshots(a, b) -> list of (field, index, a, b) where two snapshots differ")},
     {NULL,              NULL}           /* sentinel */
 };
 
@@ -984,6 +1996,40 @@ avr_exec(PyObject *m)
     if (PyType_Ready(&AVRo_Type) < 0)
         goto fail;
 
+    if (PyModule_AddIntConstant(m, "COVERAGE_MAP_SIZE", AVR_COVERAGE_MAP_SIZE) < 0 ||
+        PyModule_AddIntConstant(m, "FUZZ_BREAK", AVR_FUZZ_BREAK) < 0 ||
+        PyModule_AddIntConstant(m, "FUZZ_TIMEOUT", AVR_FUZZ_TIMEOUT) < 0)
+        goto fail;
+
+    if (PyModule_AddIntConstant(m, "FAULT_REGISTER", AVR_FAULT_REGISTER) < 0 ||
+        PyModule_AddIntConstant(m, "FAULT_SREG", AVR_FAULT_SREG) < 0 ||
+        PyModule_AddIntConstant(m, "FAULT_SRAM", AVR_FAULT_SRAM) < 0 ||
+        PyModule_AddIntConstant(m, "FAULT_FLASH", AVR_FAULT_FLASH) < 0 ||
+        PyModule_AddIntConstant(m, "OUTCOME_MASKED", AVR_OUTCOME_MASKED) < 0 ||
+        PyModule_AddIntConstant(m, "OUTCOME_CRASH", AVR_OUTCOME_CRASH) < 0 ||
+        PyModule_AddIntConstant(m, "OUTCOME_HANG", AVR_OUTCOME_HANG) < 0 ||
+        PyModule_AddIntConstant(m, "OUTCOME_SDC", AVR_OUTCOME_SDC) < 0)
+        goto fail;
+
+    if (PyModule_AddIntConstant(m, "MAP_READ", AVR_MAP_READ) < 0 ||
+        PyModule_AddIntConstant(m, "MAP_WRITE", AVR_MAP_WRITE) < 0 ||
+        PyModule_AddIntConstant(m, "MAP_COPY", AVR_MAP_COPY) < 0 ||
+        PyModule_AddIntConstant(m, "EEPROM_SIZE", EEPROM_SIZE) < 0 ||
+        PyModule_AddIntConstant(m, "STATE_BLOCK_SIZE", AVR_BLOCK_SIZE) < 0)
+        goto fail;
+
+    if (PyModule_AddIntConstant(m, "LINK_UART", AVR_LINK_UART) < 0 ||
+        PyModule_AddIntConstant(m, "LINK_SPI", AVR_LINK_SPI) < 0)
+        goto fail;
+
+    PyObject *capi = PyCapsule_New((void *)&avr_c_api, AVR_CAPI_NAME, NULL);
+    if (capi == NULL)
+        goto fail;
+    if (PyModule_AddObject(m, "_C_API", capi) < 0) {
+        Py_DECREF(capi);
+        goto fail;
+    }
+
     return 0;
  fail:
     Py_XDECREF(m);
@@ -1,6 +1,99 @@
+import asyncio
+import ctypes
+import multiprocessing
+import os
+import struct
+import tempfile
 import unittest
+from multiprocessing import shared_memory
 import avr
 
+UBRRL = 0x09
+UCSRB = 0x0A
+UCSRA = 0x0B
+UDR = 0x0C
+EECR = 0x1C
+EEDR = 0x1D
+EEARL = 0x1E
+SPMCR = 0x37
+SPM = int('1001010111101000', 2)
+BREAK = int('1001010110011000', 2)
+# BRBC T, -1: spins forever as long as the T flag is clear
+SPIN = int('1111011111111110', 2)
+
+
+def ldi(d, k):
+    return 0b1110000000000000 | ((k & 0xF0) << 4) | ((d - 16) << 4) | (k & 0x0F)
+
+
+def out(a, r):
+    return 0b1011100000000000 | ((a & 0x30) << 5) | (r << 4) | (a & 0x0F)
+
+
+def mov(d, r):
+    return 0b0010110000000000 | ((r & 0x10) << 5) | (d << 4) | (r & 0x0F)
+
+
+def in_(d, a):
+    return 0b1011000000000000 | ((a & 0x30) << 5) | (d << 4) | (a & 0x0F)
+
+
+def andi(d, k):
+    return 0b0111000000000000 | ((k & 0xF0) << 4) | ((d - 16) << 4) | (k & 0x0F)
+
+
+def add(d, r):
+    return 0b0000110000000000 | ((r & 0x10) << 5) | (d << 4) | (r & 0x0F)
+
+
+def adc(d, r):
+    return 0b0001110000000000 | ((r & 0x10) << 5) | (d << 4) | (r & 0x0F)
+
+
+def cp(d, r):
+    return 0b0001010000000000 | ((r & 0x10) << 5) | (d << 4) | (r & 0x0F)
+
+
+def cpc(d, r):
+    return 0b0000010000000000 | ((r & 0x10) << 5) | (d << 4) | (r & 0x0F)
+
+
+def cpi(d, k):
+    return 0b0011000000000000 | ((k & 0xF0) << 4) | ((d - 16) << 4) | (k & 0x0F)
+
+
+def eor(d, r):
+    return 0b0010010000000000 | ((r & 0x10) << 5) | (d << 4) | (r & 0x0F)
+
+
+def inc(d):
+    return 0b1001010000000011 | (d << 4)
+
+
+def dec(d):
+    return 0b1001010000001010 | (d << 4)
+
+
+def brbs(s, k):
+    return 0b1111000000000000 | ((k & 0x7F) << 3) | s
+
+
+def brbc(s, k):
+    return 0b1111010000000000 | ((k & 0x7F) << 3) | s
+
+
+def load_program(avr1, program):
+    for index, instruction in enumerate(program):
+        avr1.set_program_memory(instruction, index)
+
+
+def run_shared_board(name):
+    block = shared_memory.SharedMemory(name)
+    board = avr.attach(block.buf)
+    board.run_until_break()
+    del board
+    block.close()
+
 
 class TestAVR(unittest.TestCase):
     def test_registers(self):
@@ -10,6 +103,24 @@ class TestAVR(unittest.TestCase):
                 avr1.set_register(register, value)
                 self.assertEqual(avr1.get_register(register), value)
 
+    def test_register_block(self):
+        avr1 = avr.new()
+        avr1.set_registers(bytes(range(100, 132)))
+        self.assertEqual(avr1.get_registers(), bytes(range(100, 132)))
+        self.assertEqual(avr1.get_register(31), 131)
+        avr1.set_registers(b'\x01\x02')
+        self.assertEqual(avr1.get_registers()[:3], b'\x01\x02\x66')
+        with self.assertRaises(ValueError):
+            avr1.set_registers(bytes(33))
+
+        self.assertEqual(avr1.set_register(new_value=7, index=3), 7)
+        with self.assertRaises(IndexError):
+            avr1.get_register(32)
+        with self.assertRaises(OverflowError):
+            avr1.set_register(0, 256)
+        with self.assertRaises(TypeError):
+            avr1.set_register(0)
+
     def test_sreg(self):
         avr1 = avr.new()
         for value in range(0,256):
@@ -30,6 +141,186 @@ class TestAVR(unittest.TestCase):
                 self.assertEqual(get, value)
 
 
+    def test_memory_block(self):
+        avr1 = avr.new()
+        size = avr1.get_program_memory_size()
+        self.assertEqual(avr1.set_program_memory_block(2, b'\x34\x12\xff\xff'), 2)
+        self.assertEqual(avr1.get_program_memory(2), 0x1234)
+        self.assertEqual(avr1.get_program_memory(3), 0xffff)
+        self.assertEqual(avr1.set_program_memory_block(size - 1, b'\x01\x00'), 1)
+        with self.assertRaises(IndexError):
+            avr1.set_program_memory_block(size - 1, bytes(4))
+        with self.assertRaises(ValueError):
+            avr1.set_program_memory_block(0, bytes(3))
+        with self.assertRaises(IndexError):
+            avr1.set_program_memory(0, size)
+
+    def test_load_image(self):
+        avr1 = avr.new()
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, 'image.hex')
+            with open(path, 'w') as image:
+                image.write(':040004003412119809\n:00000001FF\n')
+            self.assertEqual(avr1.load_image(path), 4)
+            self.assertEqual(avr1.get_program_memory(2), 0x1234)
+            self.assertEqual(avr1.get_program_memory(3), 0x9811)
+
+            path = os.path.join(directory, 'image.bin')
+            with open(path, 'wb') as image:
+                image.write(b'\x98\x95')
+            self.assertEqual(avr1.load_image(path), 1)
+            self.assertEqual(avr1.get_program_memory(0), BREAK)
+
+            with self.assertRaises(OSError):
+                avr1.load_image(os.path.join(directory, 'missing.hex'))
+
+    def test_eeprom_flash_files(self):
+        # write 0x5A to eeprom byte 7, then program the word 0x1234 at flash word 0x100
+        program = [ldi(16, 7), out(EEARL, 16), ldi(16, 0x5A), out(EEDR, 16),
+                   ldi(16, 1 << 2), out(EECR, 16), ldi(16, 1 << 1), out(EECR, 16),
+                   ldi(16, 0x34), mov(0, 16),
+                   ldi(16, 0x12), mov(1, 16),
+                   ldi(30, 0x00), ldi(31, 0x02),
+                   ldi(16, 1), out(SPMCR, 16), SPM,
+                   ldi(16, 5), out(SPMCR, 16), SPM, BREAK]
+        with tempfile.TemporaryDirectory() as directory:
+            flash = os.path.join(directory, 'flash.bin')
+            eeprom = os.path.join(directory, 'eeprom.bin')
+            with open(flash, 'wb') as image:
+                image.write(b''.join(word.to_bytes(2, 'little') for word in program))
+
+            avr1 = avr.new()
+            self.assertEqual(avr1.attach_flash(flash, avr.MAP_WRITE), avr1.get_program_memory_size())
+            self.assertEqual(avr1.attach_eeprom(eeprom), avr.EEPROM_SIZE)
+            self.assertEqual(avr1.get_eeprom(), b'\xff' * avr.EEPROM_SIZE)
+            avr1.run_until_break()
+            self.assertEqual(avr1.get_eeprom()[7], 0x5A)
+            self.assertEqual(avr1.get_io_register(EECR) & (1 << 1), 2)
+            self.assertEqual(avr1.get_program_memory(0x100), 0x1234)
+            self.assertEqual(avr1.get_program_memory(0x101), 0xFFFF)
+            avr1.detach_flash()
+            avr1.detach_eeprom()
+            with open(flash, 'rb') as image:
+                self.assertEqual(image.read()[0x200:0x204], b'\x34\x12\xff\xff')
+
+            # a fresh board reads the byte back, a copy on write run leaves the file alone
+            avr2 = avr.new()
+            avr2.attach_eeprom(eeprom, avr.MAP_COPY)
+            load_program(avr2, [ldi(16, 7), out(EEARL, 16), ldi(16, 1), out(EECR, 16),
+                                in_(17, EEDR), BREAK])
+            avr2.run_until_break()
+            self.assertEqual(avr2.get_register(17), 0x5A)
+            avr2.set_eeprom(b'\x00\x00', 7)
+            self.assertEqual(avr2.get_eeprom()[7:9], b'\x00\x00')
+            with open(eeprom, 'rb') as data:
+                self.assertEqual(data.read()[7:9], b'\x5a\xff')
+
+            with self.assertRaises(ValueError):
+                avr2.attach_eeprom(eeprom, 3)
+            with self.assertRaises(OSError):
+                avr2.attach_flash(os.path.join(directory, 'missing.bin'))
+            with self.assertRaises(IndexError):
+                avr2.set_eeprom(b'\x00', avr.EEPROM_SIZE)
+
+    def test_c_api(self):
+        board = lambda restype, *args: ctypes.PYFUNCTYPE(restype, ctypes.py_object, *args)
+        read_hook = ctypes.CFUNCTYPE(ctypes.c_uint8, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint8)
+        write_hook = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_uint8, ctypes.c_uint8)
+
+        class IOHook(ctypes.Structure):
+            _fields_ = [('mask', ctypes.c_uint64), ('context', ctypes.c_void_p),
+                        ('read', read_hook), ('write', write_hook)]
+
+        class CAPI(ctypes.Structure):
+            _fields_ = [('version', ctypes.c_int), ('size', ctypes.c_size_t),
+                        ('snapshot_size', ctypes.c_size_t), ('board_type', ctypes.c_void_p),
+                        ('get_state', board(ctypes.c_void_p)), ('changed', board(ctypes.c_int)),
+                        ('step', board(ctypes.c_int)),
+                        ('run', board(ctypes.c_int64, ctypes.c_uint64, ctypes.c_uint64)),
+                        ('io_read', board(ctypes.c_int, ctypes.c_uint8, ctypes.POINTER(ctypes.c_uint8))),
+                        ('io_write', board(ctypes.c_int, ctypes.c_uint8, ctypes.c_uint8)),
+                        ('set_io_hook', board(ctypes.c_int, ctypes.POINTER(IOHook))),
+                        ('take_snapshot', board(ctypes.c_int, ctypes.c_char_p)),
+                        ('restore_snapshot', board(ctypes.c_int, ctypes.c_char_p))]
+
+        get_pointer = ctypes.pythonapi.PyCapsule_GetPointer
+        get_pointer.restype = ctypes.c_void_p
+        get_pointer.argtypes = [ctypes.py_object, ctypes.c_char_p]
+        api = CAPI.from_address(get_pointer(avr._C_API, b'avr._C_API'))
+        self.assertEqual(api.version, 1)
+        self.assertEqual(api.size, ctypes.sizeof(CAPI))
+
+        # PORTD writes and PIND reads go to the hook
+        written = []
+        hook = IOHook(1 << 0x12 | 1 << 0x10, None, read_hook(lambda context, core, address: 0x99),
+                      write_hook(lambda context, core, address, value: written.append((address, value))))
+        avr1 = avr.new()
+        load_program(avr1, [ldi(16, 0x42), out(0x12, 16), in_(17, 0x10), BREAK])
+        self.assertEqual(api.set_io_hook(avr1, ctypes.byref(hook)), 0)
+        snapshot = ctypes.create_string_buffer(api.snapshot_size)
+        api.take_snapshot(avr1, snapshot)
+
+        self.assertEqual(api.step(avr1), 0)
+        self.assertEqual(api.run(avr1, 2 ** 64 - 1, 2 ** 64 - 1), 3)
+        self.assertEqual(written, [(0x12, 0x42)])
+        self.assertEqual(avr1.get_register(17), 0x99)
+        self.assertEqual(avr1.get_io_register(0x12), 0)
+        value = ctypes.c_uint8()
+        api.io_read(avr1, 0x10, ctypes.byref(value))
+        self.assertEqual(value.value, 0x99)
+
+        # copies of the state don't see the hook, so nothing that runs or replays them may start
+        for start in (avr1.record_start, avr1.history_start, lambda: avr1.validate(10),
+                      lambda: avr1.fault_campaign([], 10), lambda: avr1.replay(b'')):
+            with self.assertRaises(RuntimeError):
+                start()
+
+        api.restore_snapshot(avr1, snapshot)
+        self.assertEqual(avr1.get_cycles(), 0)
+        state = api.get_state(avr1)
+        self.assertEqual(ctypes.c_uint8.from_address(state + 1 + 16).value, 0)
+        api.set_io_hook(avr1, None)
+        api.io_write(avr1, 0x12, 7)
+        self.assertEqual(avr1.get_io_register(0x12), 7)
+        avr1.history_start()
+        with self.assertRaises(RuntimeError):
+            api.set_io_hook(avr1, ctypes.byref(hook))
+        avr1.history_stop()
+        avr1.record_start()
+        with self.assertRaises(RuntimeError):
+            api.io_write(avr1, 0x12, 8)
+        with self.assertRaises(RuntimeError):
+            api.set_io_hook(avr1, ctypes.byref(hook))
+        avr1.record_stop()
+        with self.assertRaises(TypeError):
+            api.step(object())
+
+    def test_state_block(self):
+        block = shared_memory.SharedMemory(create=True, size=avr.STATE_BLOCK_SIZE)
+        try:
+            with self.assertRaises(ValueError):
+                avr.attach(block.buf)
+            avr.init_block(block.buf)
+            board = avr.attach(block.buf)
+            load_program(board, [ldi(16, 0x42), ldi(17, 0x24), BREAK])
+
+            # another process runs the board in place, the result is read straight from the block
+            process = multiprocessing.get_context('fork').Process(target=run_shared_board, args=(block.name,))
+            process.start()
+            process.join()
+            self.assertEqual(process.exitcode, 0)
+
+            layout = avr.state_layout()
+            offset = layout['registers'][0]
+            self.assertEqual(bytes(block.buf[offset + 16:offset + 18]), b'\x42\x24')
+            self.assertEqual(struct.unpack_from('=Q', block.buf, layout['cycles'][0])[0], 3)
+            self.assertEqual(board.get_register(17), 0x24)
+            self.assertEqual(board.get_program_counter(), 3)
+            del board
+        finally:
+            block.close()
+            block.unlink()
+
     def test_sreg_instructions(self):
         avr1 = avr.new()
 
@@ -92,6 +383,472 @@ class TestAVR(unittest.TestCase):
         print("Register: {0:08b}".format(avr1.get_register(0)))
         avr1.run_next_instruction()
 
+    def test_run_instructions(self):
+        avr1 = avr.new()
+        load_program(avr1, [ldi(16, 1), ldi(17, 2), BREAK, ldi(18, 3)])
+        avr1.run_instructions(2)
+        self.assertEqual(avr1.get_program_counter(), 2)
+        avr1.run_instructions(10)
+        self.assertEqual(avr1.get_program_counter(), 3)
+        self.assertEqual(avr1.get_register(18), 0)
+        with self.assertRaises(TypeError):
+            avr1.run_instructions('x')
+
+    def test_fused_pairs(self):
+        # shift a 16 bit value left five times, through LDI+LDI, ADD+ADC and CP+BRBC
+        program = [ldi(16, 5), ldi(17, 0), ldi(24, 0x81), ldi(25, 0),
+                   add(24, 24), adc(25, 25), inc(17), cp(16, 17), brbc(1, -5), BREAK]
+        avr1 = avr.new()
+        load_program(avr1, program)
+        start = avr1.take_snapshot()
+        for value, shifted in ((0x81, 0x20), (0x03, 0x60)):
+            avr1.restore_snapshot(start)
+            avr1.set_program_memory(ldi(24, value), 2)
+            avr1.run_until_break()
+            fast = avr1.take_snapshot()
+
+            avr1.restore_snapshot(start)
+            avr1.set_program_memory(ldi(24, value), 2)
+            while avr1.get_program_counter() != len(program):
+                avr1.run_next_instruction()
+            self.assertEqual(avr1.take_snapshot(), fast)
+            self.assertEqual(avr1.get_register(24), shifted)
+            self.assertEqual(avr1.get_cycles(), 4 + 5 * 5 + 4 + 1)
+
+        # the other pairs with their branch taken and not taken, every budget splits each pair once
+        programs = [
+            # DEC+BRNE, r16 = 1 falls through, DEC r16 = 3 spins since DEC does not store yet
+            [ldi(16, 1), dec(16), brbc(1, -2), ldi(16, 3), dec(16), brbc(1, -2), BREAK],
+            # CPI+BREQ taken, then not taken, CPI only keeps a Z flag that is already set
+            [ldi(16, 5), cp(16, 16), cpi(16, 5), brbs(1, 1), ldi(17, 1), cpi(16, 6), brbs(1, 1), ldi(18, 2), BREAK],
+            # 16 bit compare CP, CPC+BRNE, equal and then different in the low byte
+            [ldi(24, 0x34), ldi(25, 0x12), ldi(26, 0x34), ldi(27, 0x12),
+             cp(24, 26), cpc(25, 27), brbc(1, 1), ldi(20, 1), inc(26),
+             cp(24, 26), cpc(25, 27), brbc(1, 1), ldi(21, 1), BREAK],
+        ]
+        for program in programs:
+            avr1.restore_snapshot(avr.new().take_snapshot())
+            load_program(avr1, program)
+            start = avr1.take_snapshot()
+            for budget in range(40):
+                avr1.restore_snapshot(start)
+                avr1.run_instructions(budget)
+                fast = avr1.take_snapshot()
+                executed = avr1.get_instructions()
+
+                avr1.restore_snapshot(start)
+                for _ in range(executed):
+                    avr1.run_next_instruction()
+                self.assertEqual(avr1.take_snapshot(), fast, (program, budget))
+
+    def test_validate(self):
+        program = [ldi(16, 5), ldi(17, 0), ldi(24, 0x81), ldi(25, 0),
+                   add(24, 24), adc(25, 25), inc(17), cp(16, 17), brbc(1, -5), BREAK]
+        avr1 = avr.new()
+        load_program(avr1, program)
+        start = avr1.take_snapshot()
+        self.assertIsNone(avr1.validate(1000))
+        self.assertIsNone(avr1.validate(1000, block=3))
+        self.assertEqual(avr1.take_snapshot(), start)
+
+        # a bit flipped into the fast engine after the 7th and the 16th instruction, INC r17 at
+        # pc 6 and ADC r25, r25 at pc 5 in the third round, is found whatever the block size
+        for instructions, pc, register, reference in ((7, 6, 5, 0x00), (16, 5, 24, 0x08)):
+            for block in (1, 3, 1024):
+                report = avr1._validate_injected(1000, block, (instructions, avr.FAULT_REGISTER, register, 0x10))
+                self.assertEqual(report, {'instructions': instructions - 1, 'pc': pc, 'instruction': program[pc],
+                                          'diff': [('registers', register, reference, reference ^ 0x10)]})
+        self.assertEqual(avr1.take_snapshot(), start)
+        with self.assertRaises(ValueError):
+            avr1._validate_injected(1000, 1, (0, avr.FAULT_REGISTER, 5, 1))
+
+        avr1.set_register(16, 7)
+        self.assertEqual(avr.diff_snapshots(start, avr1.take_snapshot()), [('registers', 16, 0, 7)])
+        self.assertEqual(avr.diff_snapshots(start, start), [])
+        avr1.restore_snapshot(start)
+        avr1.uart_write(b'A')
+        self.assertEqual(avr.diff_snapshots(start, avr1.take_snapshot()),
+                         [('uart.rx.data', 0, 0, ord('A')), ('uart.rx.head', None, 0, 1)])
+        with self.assertRaises(ValueError):
+            avr.diff_snapshots(start, b'')
+
+    def test_uart_tx(self):
+        avr1 = avr.new()
+        avr1.set_io_register(UCSRB, 0b00011000)
+        load_program(avr1, [ldi(16, ord('A')), out(UDR, 16), ldi(16, ord('B')), out(UDR, 16), BREAK])
+        avr1.run_instructions(2)
+        # transmitter is busy for one frame, the second write is dropped
+        self.assertEqual(avr1.get_io_register(UCSRA) & 0b00100000, 0)
+        avr1.run_until_break()
+        self.assertEqual(avr1.uart_read(), b'A')
+
+        avr1 = avr.new()
+        avr1.set_io_register(UCSRB, 0b00011000)
+        load_program(avr1, [ldi(16, ord('A')), out(UDR, 16)] + [0] * 160 + [out(UDR, 16), BREAK])
+        avr1.run_until_break()
+        buffer = bytearray(4)
+        self.assertEqual(avr1.uart_readinto(buffer), 2)
+        self.assertEqual(buffer, b'AA\x00\x00')
+
+    def test_uart_rx(self):
+        avr1 = avr.new()
+        avr1.set_io_register(UCSRB, 0b00011000)
+        self.assertEqual(avr1.uart_write(b'xy'), 2)
+        load_program(avr1, [0, in_(17, UDR), in_(18, UDR)] + [0] * 160 + [in_(19, UDR), BREAK])
+        avr1.run_until_break()
+        self.assertEqual(avr1.get_register(17), ord('x'))
+        # the second byte needs a full frame to arrive
+        self.assertEqual(avr1.get_register(18), ord('x'))
+        self.assertEqual(avr1.get_register(19), ord('y'))
+
+    def test_uart_tx_fd(self):
+        avr1 = avr.new()
+        avr1.set_io_register(UCSRB, 0b00001000)
+        load_program(avr1, [ldi(16, ord('Z')), out(UDR, 16), BREAK])
+        read_fd, write_fd = os.pipe()
+        try:
+            avr1.uart_set_tx_fd(write_fd)
+            avr1.run_until_break()
+            self.assertEqual(os.read(read_fd, 16), b'Z')
+            self.assertEqual(avr1.uart_get_stats()['tx_pending'], 0)
+        finally:
+            os.close(read_fd)
+            os.close(write_fd)
+
+    def test_uart_tx_fd_history(self):
+        # sends a counter as fast as the UART goes, well over a ring of bytes between checkpoints
+        program = [in_(17, UCSRA), andi(17, 0x20), brbs(1, -3), out(UDR, 16), inc(16), brbc(6, -6)]
+        boards = [avr.new() for _ in range(3)]
+        for board in boards:
+            board.set_io_register(UCSRB, 0b00001000)
+            load_program(board, program)
+        with open(os.devnull, 'wb') as devnull:
+            boards[0].uart_set_tx_fd(devnull.fileno())
+            boards[1].uart_set_tx_fd(devnull.fileno())
+            boards[0].run_instructions(999999)
+            boards[1].history_start(interval=2 ** 40)
+            boards[1].run_instructions(1000000)
+            boards[1].step_back()
+            boards[0].uart_set_tx_fd(-1)
+            boards[1].uart_set_tx_fd(-1)
+        boards[2].run_instructions(999999)
+        self.assertGreater(boards[2].uart_get_stats()['tx_overruns'], 0)
+        self.assertEqual(boards[1].uart_get_stats()['tx_overruns'], 0)
+        self.assertEqual(boards[1].take_snapshot(), boards[0].take_snapshot())
+
+    def test_run_async(self):
+        async def main():
+            avr1 = avr.new()
+            load_program(avr1, [SPIN])
+            cycles = await avr1.run_async(cycles=1000)
+            self.assertGreaterEqual(cycles, 1000)
+            self.assertEqual(avr1.get_cycles(), cycles)
+
+            boards = [avr.new() for i in range(8)]
+            for board in boards:
+                load_program(board, [0] * 10 + [BREAK])
+            results = await asyncio.gather(*[board.wait_for_break() for board in boards])
+            self.assertEqual(results, [11] * 8)
+
+        asyncio.run(main())
+
+    def test_run_async_cancel(self):
+        async def main():
+            avr1 = avr.new()
+            load_program(avr1, [SPIN])
+            future = avr1.wait_for_break()
+            with self.assertRaises(RuntimeError):
+                avr1.run_next_instruction()
+            with self.assertRaises(asyncio.TimeoutError):
+                await asyncio.wait_for(future, 0.01)
+
+            # the worker stops at the next slice boundary
+            for i in range(100):
+                try:
+                    avr1.set_sreg(0)
+                    break
+                except RuntimeError:
+                    await asyncio.sleep(0.01)
+            else:
+                self.fail("worker did not stop")
+
+        asyncio.run(main())
+
+    def test_run_paced(self):
+        avr1 = avr.new()
+        load_program(avr1, [SPIN])
+        stats = avr1.run_paced(20000, frequency=1e6, batch_cycles=2000)
+        self.assertEqual(stats['cycles'], 20000)
+        self.assertEqual(stats['batches'], 10)
+        # 20000 cycles at 1 MHz take 20 ms of wall clock time
+        self.assertGreaterEqual(stats['elapsed_ns'], 20000000)
+        self.assertLessEqual(stats['max_jitter_ns'], stats['elapsed_ns'])
+
+        avr1 = avr.new()
+        load_program(avr1, [0] * 10 + [BREAK])
+        stats = avr1.run_paced(20000, frequency=1e6)
+        self.assertEqual(stats['cycles'], 11)
+
+    def test_history(self):
+        # INC r16, INC r17, OUT 0x12 r16, BRBC T back to the start
+        program = [inc(16), inc(17), out(0x12, 16), brbc(6, -4)]
+        reference = avr.new()
+        load_program(reference, program)
+        reference.run_instructions(999)
+
+        avr1 = avr.new()
+        load_program(avr1, program)
+        avr1.history_start(interval=50)
+        avr1.run_instructions(1000)
+        self.assertGreater(avr1.history_get_stats()['checkpoints'], 10)
+
+        avr1.step_back()
+        self.assertEqual(avr1.get_instructions(), 999)
+        self.assertEqual(avr1.take_snapshot(), reference.take_snapshot())
+
+        write = avr1.last_write(0x20 + 0x12)
+        self.assertEqual(write['program_counter'], 2)
+        self.assertEqual(write['instructions'], 998)
+        self.assertEqual(avr1.last_write(16)['instructions'], 996)
+        self.assertIsNone(avr1.last_write(0x100))
+
+        self.assertTrue(avr1.run_back_to(pc=1))
+        self.assertEqual(avr1.get_program_counter(), 1)
+        self.assertEqual(avr1.get_instructions(), 997)
+        self.assertFalse(avr1.run_back_to(pc=100))
+
+        self.assertTrue(avr1.run_back_to(cycle=500))
+        self.assertIn(avr1.get_cycles(), (499, 500))
+        with self.assertRaises(ValueError):
+            avr1.step_back(1000)
+
+        # host writes split the history, going back over them keeps them
+        avr1.set_register(20, 7)
+        avr1.run_instructions(100)
+        avr1.step_back(100)
+        self.assertEqual(avr1.get_register(20), 7)
+
+        avr1.history_start(interval=10, limit=4)
+        avr1.run_instructions(1000)
+        self.assertEqual(avr1.history_get_stats()['checkpoints'], 4)
+        with self.assertRaises(ValueError):
+            avr1.step_back(500)
+        avr1.history_stop()
+        self.assertIsNone(avr1.history_get_stats())
+        with self.assertRaises(RuntimeError):
+            avr1.step_back()
+
+    def test_run_system(self):
+        SPCR, SPSR, SPDR = 0x0D, 0x0E, 0x0F
+
+        # the master sends a counter and counts the answers in r25 that are not the inverse of
+        # its previous byte, the slave loads the inverse of every byte it gets as the next answer
+        master = [ldi(16, 0b01010000), out(SPCR, 16), ldi(22, 0xFF),
+                  inc(17), out(SPDR, 17), in_(18, SPSR), andi(18, 0x80), brbs(1, -3),
+                  in_(20, SPDR), eor(20, 22), cp(20, 19), brbs(1, 1), inc(25), mov(19, 17), brbc(6, -12)]
+        slave = [ldi(16, 0b01000000), out(SPCR, 16), ldi(23, 0xFF), out(SPDR, 23),
+                 in_(18, SPSR), andi(18, 0x80), brbs(1, -3),
+                 in_(19, SPDR), eor(19, 23), out(SPDR, 19), inc(22), brbc(6, -8)]
+        sender = [ldi(16, ord('h')), out(UDR, 16), SPIN]
+        receiver = [in_(17, UCSRA), andi(17, 0x80), brbs(1, -3), in_(24, UDR), SPIN]
+
+        # every byte is paired with exactly one answer whatever the quantum
+        for quantum in (1, 16, 256, 4096):
+            boards = [avr.new(), avr.new()]
+            load_program(boards[0], master)
+            load_program(boards[1], slave)
+            avr.run_system(boards, [(avr.LINK_SPI, 0, 1)], 40000, quantum=quantum)
+            self.assertGreaterEqual(boards[0].get_register(17), 4)
+            self.assertEqual(boards[0].get_register(25), 0)
+            self.assertIn(boards[1].get_register(22), (boards[0].get_register(17), boards[0].get_register(17) - 1))
+
+        boards = [avr.new() for _ in range(4)]
+        for board, program in zip(boards, [master, slave, sender, receiver]):
+            board.set_io_register(UCSRB, 0b00011000)
+            load_program(board, program)
+        start = [board.take_snapshot() for board in boards]
+        links = [(avr.LINK_SPI, 0, 1), (avr.LINK_UART, 2, 3)]
+
+        avr.run_system(boards, links, 20000, quantum=256)
+        self.assertGreaterEqual(boards[0].get_cycles(), 20000)
+        self.assertGreater(boards[0].get_register(17), 20)
+        self.assertEqual(boards[0].get_register(25), 0)
+        self.assertEqual(boards[3].get_register(24), ord('h'))
+
+        # the exchange happens at quantum boundaries only, so the threads can't change the result
+        end = [board.take_snapshot() for board in boards]
+        for board, snapshot in zip(boards, start):
+            board.restore_snapshot(snapshot)
+        avr.run_system(boards, links, 20000, quantum=256)
+        self.assertEqual([board.take_snapshot() for board in boards], end)
+
+        # delivered bytes split the history of the receiver, going back over them keeps them
+        pair = [avr.new(), avr.new()]
+        for board, program in zip(pair, [sender, receiver]):
+            board.set_io_register(UCSRB, 0b00011000)
+            load_program(board, program)
+        pair[1].history_start(interval=100000)
+        avr.run_system(pair, [(avr.LINK_UART, 0, 1)], 20000, quantum=256)
+        self.assertEqual(pair[1].get_register(24), ord('h'))
+        received = pair[1].take_snapshot()
+        pair[1].run_instructions(10)
+        pair[1].step_back(10)
+        self.assertEqual(pair[1].take_snapshot(), received)
+
+        with self.assertRaises(IndexError):
+            avr.run_system(boards, [(avr.LINK_UART, 0, 4)], 10)
+        with self.assertRaises(ValueError):
+            avr.run_system([boards[0], boards[0]], [], 10)
+
+    def test_fault_campaign(self):
+        # r16 = 5 + 3
+        program = [ldi(16, 5), ldi(17, 3), add(16, 17), BREAK]
+        avr1 = avr.new()
+        load_program(avr1, program)
+        faults = [(0, avr.FAULT_REGISTER, 16, 1),       # overwritten by LDI
+                  (1, avr.FAULT_REGISTER, 16, 1),       # r16 = 4 + 3
+                  (3, avr.FAULT_SREG, 0, 0b01000000),
+                  (0, avr.FAULT_FLASH, 3, 0x0001),      # BREAK becomes a no-op
+                  (0, avr.FAULT_FLASH, 3, BREAK ^ SPIN),
+                  (100, avr.FAULT_SRAM, 0, 0xFF)]       # after the end
+        outcomes = avr1.fault_campaign(faults, 1000, code_words=4, threads=2)
+        self.assertEqual(list(outcomes), [avr.OUTCOME_MASKED, avr.OUTCOME_SDC, avr.OUTCOME_SDC,
+                                          avr.OUTCOME_CRASH, avr.OUTCOME_HANG, avr.OUTCOME_MASKED])
+        # the board itself is not run
+        self.assertEqual(avr1.get_cycles(), 0)
+        self.assertEqual(avr1.fault_campaign(faults * 50, 1000, code_words=4), outcomes * 50)
+
+        with self.assertRaises(IndexError):
+            avr1.fault_campaign([(0, avr.FAULT_REGISTER, 32, 1)], 1000)
+        with self.assertRaises(ValueError):
+            avr1.fault_campaign([(0, avr.FAULT_SREG, 0, 0x100)], 1000)
+        with self.assertRaises(ValueError):
+            avr1.fault_campaign([], 2)
+
+    def test_fuzz_run(self):
+        # hangs when the byte at 0x60 is 'A', breaks otherwise
+        program = [ldi(30, 0x60), ldi(31, 0x00), ldi(16, 0x00), ldi(17, ord('A')),
+                   0b1001001000000101 | (16 << 4),  # LAS r16
+                   0b0001001100000001,  # CPSE r16, r17
+                   BREAK, SPIN]
+        avr1 = avr.new()
+        load_program(avr1, program)
+        start = avr1.take_snapshot()
+        coverage = bytearray(avr.COVERAGE_MAP_SIZE)
+        avr1.set_coverage_map(coverage)
+
+        self.assertEqual(avr1.fuzz_run(start, b'B', 1000, address=0x60), avr.FUZZ_BREAK)
+        self.assertEqual(avr1.get_register(16), ord('B'))
+        self.assertEqual(sum(coverage), 0)
+
+        self.assertEqual(avr1.fuzz_run(start, b'A', 1000, address=0x60), avr.FUZZ_TIMEOUT)
+        self.assertGreater(sum(coverage), 0)
+
+        # the input is part of the history, going back over it keeps it
+        avr1.history_start()
+        avr1.fuzz_run(start, b'B', 3, address=0x60)
+        placed = avr1.take_snapshot()
+        avr1.run_instructions(2)
+        avr1.step_back(2)
+        self.assertEqual(avr1.take_snapshot(), placed)
+        avr1.history_stop()
+
+        avr1.restore_snapshot(start)
+        self.assertEqual(avr1.get_cycles(), 0)
+        self.assertEqual(avr1.take_snapshot(), start)
+        avr1.set_coverage_map(None)
+        with self.assertRaises(ValueError):
+            avr1.set_coverage_map(bytearray(16))
+        with self.assertRaises(ValueError):
+            avr1.restore_snapshot(start[1:])
+
+    def test_corrupted_snapshot(self):
+        avr1 = avr.new()
+        start = avr1.take_snapshot()
+        # offsets in a snapshot are those in a block less the header
+        head = avr.state_layout()['uart.rx.head'][0] - (avr.STATE_BLOCK_SIZE - len(start))
+        corrupted = bytearray(start)
+        struct.pack_into('=I', corrupted, head, 0x10000)
+        with self.assertRaises(ValueError):
+            avr1.restore_snapshot(corrupted)
+        with self.assertRaises(ValueError):
+            avr1.fuzz_run(corrupted, b'x', 1000)
+        self.assertEqual(avr1.take_snapshot(), start)
+        self.assertEqual(avr1.uart_write(b'x' * 200000), 4096)
+
+        block = shared_memory.SharedMemory(create=True, size=avr.STATE_BLOCK_SIZE)
+        try:
+            avr.init_block(block.buf)
+            struct.pack_into('=I', block.buf, avr.state_layout()['spi.tx.tail'][0], 0xFFFF0000)
+            with self.assertRaises(ValueError):
+                avr.attach(block.buf)
+        finally:
+            block.close()
+            block.unlink()
+
+    def test_record_replay(self):
+        # sums whatever arrives through UDR and r20 into r18, forever
+        program = [in_(17, UDR), add(18, 17), add(18, 20), brbc(6, -4)]
+        avr1 = avr.new()
+        avr1.set_io_register(UCSRB, 0b00011000)
+        load_program(avr1, program)
+        start = avr1.take_snapshot()
+
+        avr1.record_start()
+        avr1.run_instructions(50)
+        avr1.uart_write(b'ab')
+        avr1.run_instructions(300)
+        avr1.set_register(20, 5)
+        avr1.run_instructions(7)
+        avr1.set_io_register(UBRRL, 3)
+        avr1.uart_write(b'c')
+        avr1.run_instructions(400)
+        log = avr1.record_stop()
+        end = avr1.take_snapshot()
+        self.assertLess(len(log), 32)
+
+        avr1.restore_snapshot(start)
+        avr1.replay(log)
+        self.assertEqual(avr1.take_snapshot(), end)
+
+        avr1.restore_snapshot(start)
+        avr1.replay(log, max_cycles=100)
+        # the budget ends on an instruction boundary
+        self.assertIn(avr1.get_cycles(), (100, 101))
+
+        with self.assertRaises(ValueError):
+            avr1.replay(log)
+        with self.assertRaises(RuntimeError):
+            avr1.record_stop()
+
+        # host writes without a log kind are refused instead of being lost
+        avr1.record_start()
+        for change in (lambda: avr1.set_program_memory(ldi(16, 0x42), 0),
+                       lambda: avr1.set_program_memory_block(0, b'\0\0'),
+                       lambda: avr1.set_eeprom(b'x'),
+                       lambda: avr1.restore_snapshot(start),
+                       lambda: avr1.fuzz_run(start, b'x', 10),
+                       lambda: avr.run_system([avr1], [], 10)):
+            with self.assertRaises(RuntimeError):
+                change()
+        avr1.record_stop()
+        self.assertEqual(avr1.get_program_memory(0), program[0])
+
+    def test_benchmark(self):
+        kernels = avr.benchmark_kernels()
+        self.assertIn(('alu_loop', 'alu'), kernels)
+        self.assertEqual({kernel_class for name, kernel_class in kernels},
+                         {'alu', 'branch', 'load_store', 'bit', 'firmware'})
+
+        results = avr.benchmark(instructions=1000, repeats=1)
+        self.assertEqual([result['kernel'] for result in results], [name for name, kernel_class in kernels])
+        for result in results:
+            self.assertEqual(result['instructions'], 1000)
+            self.assertGreater(result['mips'], 0)
+
+        with self.assertRaises(ValueError):
+            avr.benchmark('no_such_kernel')
+
     def dtest_run_all_instructions(self):
         instructions = ['0001110000000000',
                         '0000110000000000',